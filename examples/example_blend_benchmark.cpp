@@ -0,0 +1,93 @@
+// Measures the blending kernels used by widgets and the shapes overlay
+#include "canvascv/blend.h"
+
+#include <opencv2/core.hpp>
+
+#include <iostream>
+#include <functional>
+
+using namespace std;
+using namespace cv;
+using namespace canvascv;
+
+// The floating point blending widgets used before the integer kernels
+static void legacyOver(const Mat &src, Mat &dst)
+{
+    for (int r = 0; r < dst.rows; ++r)
+    {
+        const Vec4b *pSrcRow = src.ptr<Vec4b>(r);
+        Vec3b *pDstRow = dst.ptr<Vec3b>(r);
+        for (int c = 0; c < dst.cols; ++c)
+        {
+            double alpha = pSrcRow[c][3] / 255.;
+            double beta = 1. - alpha;
+            pDstRow[c][0] = (uchar) pSrcRow[c][0]*alpha + pDstRow[c][0]*beta;
+            pDstRow[c][1] = (uchar) pSrcRow[c][1]*alpha + pDstRow[c][1]*beta;
+            pDstRow[c][2] = (uchar) pSrcRow[c][2]*alpha + pDstRow[c][2]*beta;
+        }
+    }
+}
+
+// returns the average milliseconds per call
+static double timeIt(const string &name, int iterations, function<void()> func)
+{
+    func(); // warm up
+    int64 start = getTickCount();
+    for (int i = 0; i < iterations; ++i)
+    {
+        func();
+    }
+    double ms = (getTickCount() - start) * 1000. / getTickFrequency() / iterations;
+    cout << "  " << name << ": " << ms << " ms" << endl;
+    return ms;
+}
+
+static void compare(const string &title, int iterations,
+                    const Mat &src, const Mat &dstOrig,
+                    function<void(const Mat&, Mat&)> kernel)
+{
+    cout << title << endl;
+    Mat dst, dstScalar, dstSIMD;
+
+    setUseOptimized(false);
+    double scalarMs = timeIt("scalar", iterations, [&]() { dstOrig.copyTo(dst); kernel(src, dst); });
+    dst.copyTo(dstScalar);
+
+    setUseOptimized(true);
+    double simdMs = timeIt("simd  ", iterations, [&]() { dstOrig.copyTo(dst); kernel(src, dst); });
+    dst.copyTo(dstSIMD);
+
+    cout << "  speedup x" << scalarMs / simdMs
+         << ", max diff " << norm(dstScalar, dstSIMD, NORM_INF) << endl;
+}
+
+int main(int argc, char **argv)
+{
+    Size size(1920, 1080);
+    int iterations = 100;
+    if (argc > 1) iterations = atoi(argv[1]);
+
+    Mat bgra(size, CV_8UC4), bgr(size, CV_8UC3), frame(size, CV_8UC3), frame4(size, CV_8UC4);
+    randu(bgra, Scalar::all(0), Scalar::all(256));
+    randu(bgr, Scalar::all(0), Scalar::all(256));
+    randu(frame, Scalar::all(0), Scalar::all(256));
+    randu(frame4, Scalar::all(0), Scalar::all(256));
+
+    cout << "Blending " << size << " pixels, " << iterations << " iterations" << endl;
+
+    Mat dst;
+    cout << "4->3 legacy double math" << endl;
+    timeIt("double", iterations, [&]() { frame.copyTo(dst); legacyOver(bgra, dst); });
+
+    compare("4->3 over", iterations, bgra, frame, Blend::over);
+    compare("4->4 over", iterations, bgra, frame4, Blend::over);
+    compare("3->4 copyOpaque", iterations, bgr, frame4, Blend::copyOpaque);
+
+    Mat onBlack, onWhite(size, CV_8UC3), overlay;
+    randu(onWhite, Scalar::all(0), Scalar::all(256));
+    onBlack = onWhite / 2;
+    Blend::premultipliedFromPair(onBlack, onWhite, overlay);
+    compare("4->3 premultipliedOver", iterations, overlay, frame, Blend::premultipliedOver);
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+// Converts canvas shapes files between the FileStorage formats (xml, yml, json) and
+// the compact binary format (.ccvb). The formats are selected by the file extensions.
+// An output file with the ShapeStore extension (.ccvs) is written as a read only store.
+#include "canvascv/canvas.h"
+#include "canvascv/shapestore.h"
+
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+using namespace cv;
+using namespace canvascv;
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        cerr << "usage: " << argv[0] << " <input shapes file> <output shapes file>" << endl;
+        cerr << "e.g. " << argv[0] << " site.yml site" << Canvas::BINARY_FILE_EXTENSION << endl;
+        return 1;
+    }
+
+    Canvas c("convert");
+    if (! c.readShapesFromFile(argv[1]))
+    {
+        cerr << "failed reading " << argv[1] << endl;
+        return 1;
+    }
+    list<shared_ptr<Shape>> shapes;
+    c.getShapes(shapes);
+
+    string output = argv[2];
+    size_t extensionSize = strlen(ShapeStore::FILE_EXTENSION);
+    if (output.size() >= extensionSize &&
+            output.compare(output.size() - extensionSize, extensionSize, ShapeStore::FILE_EXTENSION) == 0)
+    {
+        if (! ShapeStore::write(output, shapes))
+        {
+            cerr << "failed writing " << output << endl;
+            return 1;
+        }
+    }
+    else if (! c.writeShapesToFile(output))
+    {
+        cerr << "failed writing " << output << endl;
+        return 1;
+    }
+    cout << "converted " << shapes.size() << " shapes from " << argv[1] << " to " << argv[2] << endl;
+    return 0;
+}
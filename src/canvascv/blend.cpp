@@ -0,0 +1,269 @@
+#include "blend.h"
+
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+// exact rounded x/255 for x in [0, 255*255]
+static inline int div255(int x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static void overRowScalar(const uchar *pSrc, uchar *pDst, int n, int dstCn)
+{
+    for (int c = 0; c < n; ++c, pSrc += 4, pDst += dstCn)
+    {
+        int alpha = pSrc[3];
+        int beta = 255 - alpha;
+        pDst[0] = (uchar)div255(pSrc[0] * alpha + pDst[0] * beta);
+        pDst[1] = (uchar)div255(pSrc[1] * alpha + pDst[1] * beta);
+        pDst[2] = (uchar)div255(pSrc[2] * alpha + pDst[2] * beta);
+    }
+}
+
+static void premultipliedOverRowScalar(const uchar *pSrc, uchar *pDst, int n, int dstCn)
+{
+    for (int c = 0; c < n; ++c, pSrc += 4, pDst += dstCn)
+    {
+        int alpha = pSrc[3];
+        if (alpha == 0) continue; // most of an overlay is empty
+        int beta = 255 - alpha;
+        pDst[0] = saturate_cast<uchar>(pSrc[0] + div255(pDst[0] * beta));
+        pDst[1] = saturate_cast<uchar>(pSrc[1] + div255(pDst[1] * beta));
+        pDst[2] = saturate_cast<uchar>(pSrc[2] + div255(pDst[2] * beta));
+    }
+}
+
+static void copyOpaqueRowScalar(const uchar *pSrc, uchar *pDst, int n)
+{
+    for (int c = 0; c < n; ++c, pSrc += 3, pDst += 4)
+    {
+        pDst[0] = pSrc[0];
+        pDst[1] = pSrc[1];
+        pDst[2] = pSrc[2];
+        pDst[3] = 255; // opaque
+    }
+}
+
+#if CV_SIMD128
+// The vector kernels below handle 16 pixels at a time and return how many
+// pixels of the row they handled. The scalar kernels do the rest.
+
+static inline v_uint16x8 v_div255(const v_uint16x8 &x)
+{
+    v_uint16x8 y = x + v_setall_u16(128);
+    return (y + (y >> 8)) >> 8;
+}
+
+// (s * a + d * (255 - a)) / 255 - fits in 16 bits all the way
+static inline v_uint8x16 v_blend(const v_uint8x16 &s, const v_uint8x16 &d, const v_uint8x16 &a)
+{
+    v_uint16x8 s0, s1, d0, d1, a0, a1;
+    v_expand(s, s0, s1);
+    v_expand(d, d0, d1);
+    v_expand(a, a0, a1);
+    const v_uint16x8 full = v_setall_u16(255);
+    return v_pack(v_div255(s0 * a0 + d0 * (full - a0)),
+                  v_div255(s1 * a1 + d1 * (full - a1)));
+}
+
+// s + d * (255 - a) / 255, where s was already multiplied by a
+static inline v_uint8x16 v_premultipliedBlend(const v_uint8x16 &s, const v_uint8x16 &d, const v_uint8x16 &a)
+{
+    v_uint16x8 d0, d1, b0, b1;
+    v_expand(d, d0, d1);
+    v_expand(v_setall_u8(255) - a, b0, b1);
+    return s + v_pack(v_div255(d0 * b0), v_div255(d1 * b1)); // saturating add
+}
+
+static int overRowSIMD(const uchar *pSrc, uchar *pDst, int n, int dstCn)
+{
+    int c = 0;
+    if (dstCn == 3)
+    {
+        for (; c <= n - 16; c += 16)
+        {
+            v_uint8x16 sb, sg, sr, sa, db, dg, dr;
+            v_load_deinterleave(pSrc + c * 4, sb, sg, sr, sa);
+            v_load_deinterleave(pDst + c * 3, db, dg, dr);
+            v_store_interleave(pDst + c * 3, v_blend(sb, db, sa), v_blend(sg, dg, sa), v_blend(sr, dr, sa));
+        }
+    }
+    else
+    {
+        for (; c <= n - 16; c += 16)
+        {
+            v_uint8x16 sb, sg, sr, sa, db, dg, dr, da;
+            v_load_deinterleave(pSrc + c * 4, sb, sg, sr, sa);
+            v_load_deinterleave(pDst + c * 4, db, dg, dr, da);
+            v_store_interleave(pDst + c * 4, v_blend(sb, db, sa), v_blend(sg, dg, sa), v_blend(sr, dr, sa), da);
+        }
+    }
+    return c;
+}
+
+static int premultipliedOverRowSIMD(const uchar *pSrc, uchar *pDst, int n, int dstCn)
+{
+    int c = 0;
+    if (dstCn == 3)
+    {
+        for (; c <= n - 16; c += 16)
+        {
+            v_uint8x16 sb, sg, sr, sa, db, dg, dr;
+            v_load_deinterleave(pSrc + c * 4, sb, sg, sr, sa);
+            v_load_deinterleave(pDst + c * 3, db, dg, dr);
+            v_store_interleave(pDst + c * 3,
+                               v_premultipliedBlend(sb, db, sa),
+                               v_premultipliedBlend(sg, dg, sa),
+                               v_premultipliedBlend(sr, dr, sa));
+        }
+    }
+    else
+    {
+        for (; c <= n - 16; c += 16)
+        {
+            v_uint8x16 sb, sg, sr, sa, db, dg, dr, da;
+            v_load_deinterleave(pSrc + c * 4, sb, sg, sr, sa);
+            v_load_deinterleave(pDst + c * 4, db, dg, dr, da);
+            v_store_interleave(pDst + c * 4,
+                               v_premultipliedBlend(sb, db, sa),
+                               v_premultipliedBlend(sg, dg, sa),
+                               v_premultipliedBlend(sr, dr, sa),
+                               da);
+        }
+    }
+    return c;
+}
+
+static int copyOpaqueRowSIMD(const uchar *pSrc, uchar *pDst, int n)
+{
+    int c = 0;
+    const v_uint8x16 opaque = v_setall_u8(255);
+    for (; c <= n - 16; c += 16)
+    {
+        v_uint8x16 b, g, r;
+        v_load_deinterleave(pSrc + c * 3, b, g, r);
+        v_store_interleave(pDst + c * 4, b, g, r, opaque);
+    }
+    return c;
+}
+#else
+static int overRowSIMD(const uchar *, uchar *, int, int) { return 0; }
+static int premultipliedOverRowSIMD(const uchar *, uchar *, int, int) { return 0; }
+static int copyOpaqueRowSIMD(const uchar *, uchar *, int) { return 0; }
+#endif
+
+void Blend::premultipliedFromPair(const Mat &onBlack, const Mat &onWhite, Mat &overlay)
+{
+    CV_Assert(onBlack.type() == CV_8UC3 && onWhite.type() == CV_8UC3);
+    CV_Assert(onBlack.size() == onWhite.size());
+    overlay.create(onBlack.size(), CV_8UC4);
+    for (int r = 0; r < onBlack.rows; ++r)
+    {
+        const uchar *pBlack = onBlack.ptr<uchar>(r);
+        const uchar *pWhite = onWhite.ptr<uchar>(r);
+        uchar *pOut = overlay.ptr<uchar>(r);
+        for (int c = 0; c < onBlack.cols; ++c, pBlack += 3, pWhite += 3, pOut += 4)
+        {
+            // whatever is left of the white background is the transparency
+            int transparency = max(max(pWhite[0] - pBlack[0], pWhite[1] - pBlack[1]), pWhite[2] - pBlack[2]);
+            transparency = min(max(transparency, 0), 255);
+            pOut[0] = pBlack[0];
+            pOut[1] = pBlack[1];
+            pOut[2] = pBlack[2];
+            pOut[3] = (uchar)(255 - transparency);
+        }
+    }
+}
+
+void Blend::premultipliedOver(const Mat &overlay, Mat &dst)
+{
+    CV_Assert(overlay.type() == CV_8UC4 && (dst.type() == CV_8UC3 || dst.type() == CV_8UC4));
+    CV_Assert(overlay.size() == dst.size());
+    bool simd = useOptimized();
+    int dstCn = dst.channels();
+    for (int r = 0; r < dst.rows; ++r)
+    {
+        const uchar *pSrc = overlay.ptr<uchar>(r);
+        uchar *pDst = dst.ptr<uchar>(r);
+        int c = simd ? premultipliedOverRowSIMD(pSrc, pDst, dst.cols, dstCn) : 0;
+        premultipliedOverRowScalar(pSrc + c * 4, pDst + c * dstCn, dst.cols - c, dstCn);
+    }
+}
+
+void Blend::over(const Mat &src, Mat &dst)
+{
+    CV_Assert(src.type() == CV_8UC4 && (dst.type() == CV_8UC3 || dst.type() == CV_8UC4));
+    CV_Assert(src.size() == dst.size());
+    bool simd = useOptimized();
+    int dstCn = dst.channels();
+    for (int r = 0; r < dst.rows; ++r)
+    {
+        const uchar *pSrc = src.ptr<uchar>(r);
+        uchar *pDst = dst.ptr<uchar>(r);
+        int c = simd ? overRowSIMD(pSrc, pDst, dst.cols, dstCn) : 0;
+        overRowScalar(pSrc + c * 4, pDst + c * dstCn, dst.cols - c, dstCn);
+    }
+}
+
+void Blend::copyOpaque(const Mat &src, Mat &dst)
+{
+    CV_Assert(src.type() == CV_8UC3 && dst.type() == CV_8UC4);
+    CV_Assert(src.size() == dst.size());
+    bool simd = useOptimized();
+    for (int r = 0; r < dst.rows; ++r)
+    {
+        const uchar *pSrc = src.ptr<uchar>(r);
+        uchar *pDst = dst.ptr<uchar>(r);
+        int c = simd ? copyOpaqueRowSIMD(pSrc, pDst, dst.cols) : 0;
+        copyOpaqueRowScalar(pSrc + c * 3, pDst + c * 4, dst.cols - c);
+    }
+}
+
+void Blend::flatten(const Mat &bg, const Mat &fg, Mat &flat)
+{
+    CV_Assert(bg.empty() || bg.type() == CV_8UC4);
+    CV_Assert(fg.empty() || fg.type() == CV_8UC4);
+    CV_Assert(bg.empty() || fg.empty() || bg.size() == fg.size());
+    const Size size = bg.empty() ? fg.size() : bg.size();
+    flat.create(size, CV_8UC4);
+    for (int r = 0; r < size.height; ++r)
+    {
+        const uchar *pBG = bg.empty() ? nullptr : bg.ptr<uchar>(r);
+        const uchar *pFG = fg.empty() ? nullptr : fg.ptr<uchar>(r);
+        uchar *pOut = flat.ptr<uchar>(r);
+        for (int c = 0; c < size.width; ++c, pOut += 4)
+        {
+            int bgAlpha = 0, fgAlpha = 0;
+            int color[3] = {0, 0, 0};
+            if (pBG)
+            {
+                bgAlpha = pBG[3];
+                for (int i = 0; i < 3; ++i) color[i] = div255(pBG[i] * bgAlpha);
+                pBG += 4;
+            }
+            if (pFG)
+            {
+                fgAlpha = pFG[3];
+                int beta = 255 - fgAlpha;
+                for (int i = 0; i < 3; ++i) color[i] = div255(pFG[i] * fgAlpha) + div255(color[i] * beta);
+                bgAlpha = div255(bgAlpha * beta);
+                pFG += 4;
+            }
+            pOut[0] = saturate_cast<uchar>(color[0]);
+            pOut[1] = saturate_cast<uchar>(color[1]);
+            pOut[2] = saturate_cast<uchar>(color[2]);
+            pOut[3] = saturate_cast<uchar>(fgAlpha + bgAlpha);
+        }
+    }
+}
+
+}
@@ -0,0 +1,75 @@
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <opencv2/core.hpp>
+
+namespace canvascv
+{
+
+/**
+ * @brief The Blend class
+ *
+ * The place for the pixel blending kernels used when compositing onto frames.
+ * Premultiplied buffers are BGRA where the BGR values were already multiplied by alpha.
+ *
+ * All the kernels use 8 bit integer math. They are vectorized with the OpenCV universal
+ * intrinsics (SSE2/NEON...) when available, and fall back to the scalar reference code
+ * when cv::setUseOptimized(false) is used.
+ */
+class Blend
+{
+public:
+    /**
+     * @brief premultipliedFromPair
+     *
+     * Build a premultiplied overlay from the same drawing done twice, once on black and
+     * once on white. Anti aliased OpenCV drawing is linear in the background, so the
+     * difference between the 2 results is the transparency of each pixel.
+     * @param onBlack is the drawing on a black CV_8UC3 Mat (also the premultiplied color)
+     * @param onWhite is the drawing on a white CV_8UC3 Mat
+     * @param overlay will be a CV_8UC4 premultiplied Mat of the same size
+     */
+    static void premultipliedFromPair(const cv::Mat &onBlack, const cv::Mat &onWhite, cv::Mat &overlay);
+
+    /**
+     * @brief premultipliedOver
+     *
+     * dst = overlay + dst * (1 - overlay alpha)
+     * @param overlay is a CV_8UC4 premultiplied Mat
+     * @param dst is a CV_8UC3 or CV_8UC4 Mat of the same size (its alpha is not changed)
+     */
+    static void premultipliedOver(const cv::Mat &overlay, cv::Mat &dst);
+
+    /**
+     * @brief over
+     *
+     * dst = src * src alpha + dst * (1 - src alpha)
+     * @param src is a CV_8UC4 Mat (not premultiplied)
+     * @param dst is a CV_8UC3 or CV_8UC4 Mat of the same size (its alpha is not changed)
+     */
+    static void over(const cv::Mat &src, cv::Mat &dst);
+
+    /**
+     * @brief copyOpaque
+     *
+     * copy the colors of src into dst, with an opaque alpha
+     * @param src is a CV_8UC3 Mat
+     * @param dst is a CV_8UC4 Mat of the same size
+     */
+    static void copyOpaque(const cv::Mat &src, cv::Mat &dst);
+
+    /**
+     * @brief flatten
+     *
+     * Combine 2 layers into a single premultiplied layer, so blending it with premultipliedOver()
+     * is the same as blending bg and then fg with over().
+     * @param bg is a CV_8UC4 Mat (not premultiplied), or an empty Mat
+     * @param fg is a CV_8UC4 Mat (not premultiplied) of the same size, or an empty Mat
+     * @param flat will be a new CV_8UC4 premultiplied Mat
+     */
+    static void flatten(const cv::Mat &bg, const cv::Mat &fg, cv::Mat &flat);
+};
+
+}
+
+#endif // BLEND_H
@@ -1,15 +1,21 @@
 #include "canvas.h"
+#include "blend.h"
 #include "colors.h"
+#include "drawlist.h"
+#include "painter.h"
+#include "renderthread.h"
+#include "shapes/binaryarchive.h"
 #include "shapes/shapefactory.h"
 #include "shapes/shape.h"
 #include "shapes/shapesconnector.h"
 #include "themes/themerepository.h"
 #include "themes/theme.h"
 
-#include "widgets/msgbox.h"
-
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 
 using namespace std;
 using namespace cv;
@@ -17,6 +23,9 @@ using namespace cv;
 namespace canvascv
 {
 
+// above this amount of separate damaged areas the whole frame is redrawn
+static const size_t MAX_DAMAGE_RECTS = 32;
+
 Canvas::Canvas(const string &winNameVal, Size sizeVal)
     : on(true),
       isDirty(false),
@@ -24,7 +33,20 @@ Canvas::Canvas(const string &winNameVal, Size sizeVal)
       hasScreenText(false),
       hasStatusMsg(false),
       dragPos(0,0),
-      winName(winNameVal)
+      winName(winNameVal),
+      incrementalRedraw(false),
+      fullDamage(true),
+      lastSrcData(nullptr),
+      lastDstData(nullptr),
+      retainedOverlay(false),
+      overlayDirty(true),
+      parallelRedraw(false),
+      parallelTileSize(256),
+      drawAreas(nullptr),
+      shapesDrawn(0),
+      shapesCulled(0),
+      asyncReady(false),
+      zoneMapDirty(true)
 {
     if (sizeVal.width && sizeVal.height)
     {
@@ -40,52 +62,508 @@ Canvas::~Canvas()
 
 void Canvas::redrawOn(const Mat &src, Mat &dst)
 {
-    if (&src != &dst)
+    if (incrementalRedraw && on && &src != &dst)
     {
-        dst.create(src.size(), src.type());
-        src.copyTo(dst);
+        redrawIncrementalOn(src, dst);
+        return;
+    }
+
+    RenderProfiler::Frame frame(profiler.get());
+    {
+        RenderProfiler::Scope scope(profiler.get(), RenderProfiler::INPUT);
+        if (&src != &dst)
+        {
+            dst.create(src.size(), src.type());
+            src.copyTo(dst);
+        }
+        if (on && src.channels() == 1)
+        {
+            cv::cvtColor(src, dst, CV_GRAY2BGR);
+        }
+    }
+    if (! on)
+    {
+        flushImmediateLayer();
+        return;
     }
-    if (! on) return;
 
     latestFrameSrc = src;
 
-    if (src.channels() == 1)
+    if (hasStatusMsg)
+    {
+        statusMsg->setLocation(Point(5, dst.rows - 5));
+    }
+
+    // Updating dirty widgets before drawing them
     {
-        cv::cvtColor(src, dst, CV_GRAY2BGR);
+        RenderProfiler::Scope scope(profiler.get(), RenderProfiler::UPDATE_WIDGETS);
+        updateDirtyWidgets();
     }
 
-    for (auto &shape : shapes)
+    renderScene(dst, vector<Rect>());
+
+    flushImmediateLayer();
+    clearDamage();
+    fullDamage = true; // nothing was retained for the incremental redraw
+    isDirty = false;
+}
+
+void Canvas::redrawIncrementalOn(const Mat &src, Mat &dst)
+{
+    RenderProfiler::Frame frame(profiler.get());
+    int outType = CV_MAKETYPE(src.depth(), src.channels() == 1 ? 3 : src.channels());
+    if (src.data != lastSrcData ||
+            retainedOut.size() != src.size() ||
+            retainedOut.type() != outType)
+    {
+        fullDamage = true;
+    }
+    latestFrameSrc = src;
+    lastSrcData = src.data;
+
+    if (hasStatusMsg)
+    {
+        statusMsg->setLocation(Point(5, src.rows - 5));
+    }
+
+    // Updating dirty widgets before collecting their damage
+    {
+        RenderProfiler::Scope scope(profiler.get(), RenderProfiler::UPDATE_WIDGETS);
+        updateDirtyWidgets();
+    }
+
+    collectDamage(src.size());
+
+    if (fullDamage)
+    {
+        {
+            RenderProfiler::Scope scope(profiler.get(), RenderProfiler::INPUT);
+            if (src.channels() == 1)
+            {
+                cv::cvtColor(src, retainedOut, CV_GRAY2BGR);
+            }
+            else
+            {
+                src.copyTo(retainedOut);
+            }
+        }
+        renderScene(retainedOut, vector<Rect>());
+    }
+    else if (damageRects.size())
     {
-        if (shape->getVisible())
+        // shapes are drawn in canvas coordinates, so we draw on a full size scratch
+        // and only take the damaged areas from it
+        damageScratch.create(src.size(), outType);
+        {
+            RenderProfiler::Scope scope(profiler.get(), RenderProfiler::INPUT);
+            for (auto &rect : damageRects)
+            {
+                Mat scratchROI = damageScratch(rect);
+                if (src.channels() == 1)
+                {
+                    cv::cvtColor(src(rect), scratchROI, CV_GRAY2BGR);
+                }
+                else
+                {
+                    src(rect).copyTo(scratchROI);
+                }
+            }
+        }
+        renderScene(damageScratch, damageRects);
+        for (auto &rect : damageRects)
         {
-            shape->draw(dst);
+            Mat retainedROI = retainedOut(rect);
+            damageScratch(rect).copyTo(retainedROI);
         }
     }
 
-    // Updating dirty widgets before drawing them
-    updateDirtyWidgets();
+    if (! fullDamage &&
+            dst.data == lastDstData &&
+            dst.size() == retainedOut.size() &&
+            dst.type() == retainedOut.type())
+    {   // dst still holds our previous output
+        for (auto &rect : damageRects)
+        {
+            Mat dstROI = dst(rect);
+            retainedOut(rect).copyTo(dstROI);
+        }
+    }
+    else
+    {
+        retainedOut.copyTo(dst);
+    }
+    lastDstData = dst.data;
+
+    flushImmediateLayer();
+    damageRects.clear();
+    fullDamage = false;
+    isDirty = false;
+}
+
+static bool touchesAny(const Rect &rect, const vector<Rect> &areas)
+{
+    if (areas.empty()) return true;
+    for (auto &area : areas)
+    {
+        if (rectsIntersect(rect, area)) return true;
+    }
+    return false;
+}
+
+void Canvas::renderScene(Mat &dst, const vector<Rect> &areas)
+{
+    {
+        RenderProfiler::Scope scope(profiler.get(), RenderProfiler::SHAPES);
+        if (shapeStore) shapeStore->renderOn(dst, areas);
+
+        // the overlay is not recorded, the shapes themselves are
+        if (retainedOverlay && areas.empty() && dst.type() == CV_8UC3 && ! Painter::isRecording())
+        {
+            updateShapesOverlay(dst.size());
+            if (overlayBounds.area())
+            {
+                Mat dstROI = dst(overlayBounds);
+                Blend::premultipliedOver(shapesOverlay(overlayBounds), dstROI);
+            }
+        }
+        else
+        {
+            drawShapes(dst, areas);
+        }
+    }
+    renderOverlays(dst, areas);
+}
+
+void Canvas::renderOverlays(Mat &dst, const vector<Rect> &areas)
+{
+    if (! immediateLayer.empty() && touchesAny(immediateLayer.getBounds(), areas))
+    {
+        RenderProfiler::Scope scope(profiler.get(), RenderProfiler::IMMEDIATE_LAYER);
+        immediateLayer.renderOn(dst);
+    }
 
     // widgets are drawn on top of shapes
-    for (auto &widget : widgets)
     {
-        if (widget->getVisible())
+        RenderProfiler::Scope scope(profiler.get(), RenderProfiler::WIDGETS);
+        for (auto &widget : widgets)
         {
-            widget->renderOn(dst);
+            if (widget->getVisible() && touchesAny(widget->getRect(), areas))
+            {
+                widget->renderOn(dst);
+            }
         }
     }
 
     // These go on top of everything
-    if (hasScreenText)
+    RenderProfiler::Scope scope(profiler.get(), RenderProfiler::TEXTS);
+    if (hasScreenText && touchesAny(screenText->getRect(), areas))
     {
         static_cast<Widget*>(screenText.get())->renderOn(dst);
     }
-    if (hasStatusMsg)
+    if (hasStatusMsg && touchesAny(statusMsg->getRect(), areas))
     {
-        statusMsg->setLocation(Point(5, dst.rows - 5));
         static_cast<Widget*>(statusMsg.get())->renderOn(dst);
     }
+}
 
-    isDirty = false;
+class Canvas::ParallelShapesDraw : public ParallelLoopBody
+{
+public:
+    ParallelShapesDraw(const vector<Shape*> &shapesVal, Mat &dstVal)
+        : shapes(shapesVal), dst(dstVal) {}
+
+    virtual void operator()(const Range &range) const
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            shapes[i]->draw(dst);
+        }
+    }
+
+private:
+    const vector<Shape*> &shapes;
+    Mat &dst;
+};
+
+bool Canvas::cull(const Rect &bounds, const Mat &dst)
+{
+    bool culled = ! rectsIntersect(bounds, Rect(Point(0, 0), dst.size())) ||
+            (drawAreas && ! touchesAny(bounds, *drawAreas));
+    (culled ? shapesCulled : shapesDrawn).fetch_add(1, memory_order_relaxed);
+    return culled;
+}
+
+void Canvas::drawShapes(Mat &dst, const vector<Rect> &areas)
+{
+    shapesDrawn = 0;
+    shapesCulled = 0;
+    drawAreas = &areas;
+    // culling scans the dense bounds of the slots, and only the drawn shapes are visited
+    shapes.refresh();
+    if (! parallelRedraw || Painter::isRecording()) // recording is per thread
+    {
+        for (size_t slot = 0; slot < shapes.getSlotCount(); ++slot)
+        {
+            if (shapes.isVisible(slot) && ! cull(shapes.getBounds(slot), dst))
+            {
+                Shape *shape = shapes.getShape(slot).get();
+                if (profiler)
+                {
+                    int64 start = getTickCount();
+                    shape->draw(dst);
+                    profiler->addShape(shape->getType(), getTickCount() - start);
+                }
+                else
+                {
+                    shape->draw(dst);
+                }
+            }
+        }
+        drawAreas = nullptr;
+        return;
+    }
+
+    // Each shape goes to the wave after the last wave which used any of its tiles.
+    // Shapes in the same wave touch different pixels, so they can be drawn at the
+    // same time, and the order of shapes sharing a pixel is kept between waves.
+    const Rect frame(Point(0, 0), dst.size());
+    const int tileCols = (frame.width + parallelTileSize - 1) / parallelTileSize;
+    const int tileRows = (frame.height + parallelTileSize - 1) / parallelTileSize;
+    vector<int> tileWave(tileCols * tileRows, 0);
+    vector<vector<Shape*>> waves;
+    for (size_t slot = 0; slot < shapes.getSlotCount(); ++slot)
+    {
+        if (! shapes.isVisible(slot) || cull(shapes.getBounds(slot), dst)) continue;
+
+        Rect bounds = shapes.getBounds(slot) & frame;
+
+        int tx0 = bounds.x / parallelTileSize;
+        int ty0 = bounds.y / parallelTileSize;
+        int tx1 = (bounds.x + bounds.width - 1) / parallelTileSize;
+        int ty1 = (bounds.y + bounds.height - 1) / parallelTileSize;
+        int wave = 0;
+        for (int ty = ty0; ty <= ty1; ++ty)
+        {
+            for (int tx = tx0; tx <= tx1; ++tx)
+            {
+                wave = max(wave, tileWave[ty * tileCols + tx]);
+            }
+        }
+        ++wave;
+        for (int ty = ty0; ty <= ty1; ++ty)
+        {
+            for (int tx = tx0; tx <= tx1; ++tx)
+            {
+                tileWave[ty * tileCols + tx] = wave;
+            }
+        }
+        if ((int)waves.size() < wave) waves.resize(wave);
+        waves[wave - 1].push_back(shapes.getShape(slot).get());
+    }
+
+    for (auto &wave : waves)
+    {
+        if (wave.size() == 1)
+        {
+            wave.front()->draw(dst);
+        }
+        else
+        {
+            parallel_for_(Range(0, (int)wave.size()), ParallelShapesDraw(wave, dst));
+        }
+    }
+    drawAreas = nullptr;
+}
+
+void Canvas::updateShapesOverlay(const Size &frameSize)
+{
+    if (! overlayDirty && shapesOverlay.size() == frameSize) return;
+
+    overlayBounds = Rect();
+    shapes.refresh();
+    for (size_t slot = 0; slot < shapes.getSlotCount(); ++slot)
+    {
+        if (shapes.isVisible(slot))
+        {
+            overlayBounds = rectUnion(overlayBounds, shapes.getBounds(slot));
+        }
+    }
+    overlayBounds &= Rect(Point(0, 0), frameSize);
+
+    // Colors used by shapes don't have to be opaque, so the alpha of the
+    // overlay is measured by drawing everything on 2 backgrounds
+    shapesOverlay.create(frameSize, CV_8UC4);
+    if (overlayBounds.area())
+    {
+        Mat onBlack(frameSize, CV_8UC3, Scalar::all(0));
+        Mat onWhite(frameSize, CV_8UC3, Scalar::all(255));
+        drawShapes(onBlack, vector<Rect>());
+        drawShapes(onWhite, vector<Rect>());
+        Mat overlayROI = shapesOverlay(overlayBounds);
+        Blend::premultipliedFromPair(onBlack(overlayBounds), onWhite(overlayBounds), overlayROI);
+    }
+    overlayDirty = false;
+}
+
+void Canvas::addDamage(const Rect &area)
+{
+    if (incrementalRedraw && area.width > 0 && area.height > 0)
+    {
+        damageRects.push_back(area);
+    }
+}
+
+void Canvas::collectDamage(const Size &frameSize)
+{
+    auto widgetDamage = [this](Widget *widget, bool shown)
+    {
+        Rect rect = (shown && widget->getVisible()) ? widget->getRect() : Rect();
+        if (widget->damaged || rect != widget->drawnRect)
+        {
+            addDamage(widget->drawnRect);
+            addDamage(rect);
+            widget->drawnRect = rect;
+            widget->damaged = false;
+        }
+    };
+
+    if (fullDamage)
+    {   // everything is redrawn, just refresh what is on screen
+        for (auto &shape : shapes)
+        {
+            shape->updateDrawnBounds();
+        }
+    }
+    for (Shape *shape : damagedShapes)
+    {
+        addDamage(shape->drawnBounds);
+        shape->updateDrawnBounds();
+        addDamage(shape->drawnBounds);
+        shape->damaged = false;
+    }
+    damagedShapes.clear();
+
+    for (auto &widget : widgets)
+    {
+        widgetDamage(widget.get(), true);
+    }
+    if (screenText.get()) widgetDamage(screenText.get(), hasScreenText);
+    if (statusMsg.get()) widgetDamage(statusMsg.get(), hasStatusMsg);
+
+    // the immediate layer is replaced every frame
+    addDamage(immediateDrawn);
+    addDamage(immediateLayer.getBounds());
+
+    if (fullDamage)
+    {
+        damageRects.clear();
+        return;
+    }
+
+    // clip to the frame and merge overlapping rects
+    const Rect frame(Point(0, 0), frameSize);
+    vector<Rect> merged;
+    int totalArea = 0;
+    for (Rect rect : damageRects)
+    {
+        rect &= frame;
+        if (rect.area() == 0) continue;
+        bool grew = true;
+        while (grew)
+        {
+            grew = false;
+            for (auto i = merged.begin(); i != merged.end(); ++i)
+            {
+                if (rectsIntersect(*i, rect))
+                {
+                    rect = rectUnion(*i, rect);
+                    merged.erase(i);
+                    grew = true;
+                    break;
+                }
+            }
+        }
+        merged.push_back(rect);
+    }
+    for (auto &rect : merged)
+    {
+        totalArea += rect.area();
+    }
+
+    // many small copies or a large area are not worth the book keeping
+    if (merged.size() > MAX_DAMAGE_RECTS || totalArea * 2 > frame.area())
+    {
+        fullDamage = true;
+        merged.clear();
+    }
+    damageRects.swap(merged);
+}
+
+void Canvas::clearDamage()
+{
+    for (Shape *shape : damagedShapes)
+    {
+        shape->damaged = false;
+    }
+    damagedShapes.clear();
+    damageRects.clear();
+}
+
+void Canvas::damageActive()
+{
+    if (activeShape.get())
+    {
+        setDirty(*activeShape);
+    }
+    if (activeWidget.get())
+    {
+        activeWidget->damaged = true;
+    }
+}
+
+void Canvas::setDirty(Shape &shape)
+{
+    ++shape.version; // it may look different, even if it didn't move
+    isDirty = true;
+    overlayDirty = true;
+    shapeIndex.invalidate(&shape);
+    shapes.invalidate(shape);
+    if (ZoneMap::isMapped(shape)) zoneMapDirty = true;
+    if (! shape.damaged)
+    {
+        shape.damaged = true;
+        damagedShapes.push_back(&shape);
+    }
+}
+
+void Canvas::indexIds(const shared_ptr<Shape> &shape)
+{
+    idIndex[shape->getId()] = shape;
+    list<shared_ptr<Shape>> subShapes;
+    shape->getSubShapes(subShapes);
+    for (auto &subShape : subShapes)
+    {
+        indexIds(subShape);
+    }
+}
+
+void Canvas::unindexIds(Shape &shape)
+{
+    auto iter = idIndex.find(shape.getId());
+    if (iter != idIndex.end())
+    {
+        shared_ptr<Shape> indexed = iter->second.lock();
+        if (! indexed || indexed.get() == &shape)
+        {
+            idIndex.erase(iter);
+        }
+    }
+    list<shared_ptr<Shape>> subShapes;
+    shape.getSubShapes(subShapes);
+    for (auto &subShape : subShapes)
+    {
+        unindexIds(*subShape);
+    }
 }
 
 void Canvas::redrawOn(Mat &dst)
@@ -98,6 +576,7 @@ void Canvas::setImage(const Mat &img)
     latestFrameSrc = img;
     setSize(img.size());
     isDirty = true;
+    fullDamage = true;
 }
 
 bool Canvas::onMousePress(const Point &pos)
@@ -105,6 +584,7 @@ bool Canvas::onMousePress(const Point &pos)
     if (! on) return false;
     isDirty = true;
     StatusMsgGrd(*this);
+    DamageGrd damageGrd(*this);
 
     // widgets have preference over shapes
     if (activeWidget.get())
@@ -151,7 +631,9 @@ bool Canvas::onMousePress(const Point &pos)
     }
 
     // try to set active shape
-    for (auto &shape : shapes)
+    vector<shared_ptr<Shape>> candidates;
+    shapeIndex.query(pos, candidates);
+    for (auto &shape : candidates)
     {
         if (shape->mousePressed(pos))
         {
@@ -164,7 +646,7 @@ bool Canvas::onMousePress(const Point &pos)
     // create a new shape and set it as active
     if (shapeType.length())
     {
-        shapes.push_back(std::shared_ptr<Shape>(ShapeFactory::newShape(shapeType,pos)));
+        shapes.push_back(ShapePool::share(ShapeFactory::newShape(shapeType,pos)));
         processNewShape();
         if (! activeShape->mousePressed(pos, true))
         {
@@ -193,6 +675,7 @@ void Canvas::onMouseRelease(const Point &pos)
     if (! on) return;
     isDirty = true;
     StatusMsgGrd(*this);
+    DamageGrd damageGrd(*this);
 
     dragPos.x = dragPos.y = 0;
 
@@ -241,6 +724,7 @@ void Canvas::onMouseMove(const Point &pos)
     if (! on) return;
     isDirty = true;
     StatusMsgGrd(*this);
+    DamageGrd damageGrd(*this);
 
     // widgets have preference over shapes
     if (activeWidget.get())
@@ -286,7 +770,7 @@ void Canvas::onMouseMove(const Point &pos)
 
 std::shared_ptr<Shape> Canvas::createShape(string type, const Point &pos)
 {
-    std::shared_ptr<Shape> shape(ShapeFactory::newShape(type, pos));
+    std::shared_ptr<Shape> shape = ShapePool::share(ShapeFactory::newShape(type, pos));
     shapes.push_back(shape);
     processNewShape();
     shape->setReady();
@@ -296,6 +780,12 @@ std::shared_ptr<Shape> Canvas::createShape(string type, const Point &pos)
     return shape;
 }
 
+int Canvas::processKey(int key)
+{
+    consumeKey(key);
+    return key;
+}
+
 void Canvas::consumeKey(int &key)
 {
     if (! on) return;
@@ -306,6 +796,7 @@ void Canvas::consumeKey(int &key)
         if (activeShape.get())
         {
             isDirty = true;
+            DamageGrd damageGrd(*this);
             bool wasReady = activeShape->isReady();
             if (! activeShape->keyPressed(key))
             {
@@ -349,8 +840,19 @@ void Canvas::deleteShape(const std::shared_ptr<Shape> &shape)
     {
         connector->disconnectShape(shape->getId());
     }
-    shapes.erase(find(shapes.begin(),shapes.end(),shape));
+    addDamage(shape->drawnBounds);
+    if (shape->damaged)
+    {
+        damagedShapes.erase(find(damagedShapes.begin(), damagedShapes.end(), shape.get()));
+        shape->damaged = false;
+    }
+    shapeIndex.remove(shape.get());
+    unindexIds(*shape);
+    if (ZoneMap::isMapped(*shape)) zoneMapDirty = true;
+    shape->canvas = nullptr; // a deleted shape can't make us dirty anymore
+    shapes.erase(shape.get());
     isDirty = true;
+    overlayDirty = true;
 }
 
 void Canvas::deleteWidget(const std::shared_ptr<Widget> &widget)
@@ -389,6 +891,16 @@ void Canvas::rmvNotifyOnShapeDelete(Canvas::CBIDCanvasShape cbid)
     deleteNotifs.delCB(cbid); 
 }
 
+Canvas::CBIDCanvasShapes Canvas::notifyOnShapesRead(Canvas::CBCanvasShapes cb)
+{
+    return readNotifs.addCB(cb);
+}
+
+void Canvas::rmvNotifyOnShapesRead(Canvas::CBIDCanvasShapes cbid)
+{
+    readNotifs.delCB(cbid);
+}
+
 void Canvas::clearShapes()
 {
     deleteActive();
@@ -410,25 +922,20 @@ void Canvas::clearWidgets()
 
 std::shared_ptr<Shape> Canvas::getShape(int id)
 {
-    for (auto &shape : shapes)
+    auto iter = idIndex.find(id);
+    if (iter == idIndex.end())
     {
-        if (shape->getId() == id)
-        {
-            return shape;
-        }
-        std::shared_ptr<Shape> subShape = shape->getShape(id);
-        if (subShape.get())
-        {
-            return subShape;
-        }
+        return nullptr;
     }
-    return nullptr;
+    return iter->second.lock();
 }
 
 void Canvas::getShapes(const Point &pos, std::list<std::shared_ptr<Shape> > &result)
 {
     result.clear();
-    for (auto &shape : shapes)
+    vector<shared_ptr<Shape>> candidates;
+    shapeIndex.query(pos, candidates);
+    for (auto &shape : candidates)
     {
         if (shape->isAtPos(pos))
         {
@@ -496,6 +1003,8 @@ void Canvas::setScreenText(const string &msg)
 
 void Canvas::broadcastCreate(Shape *shape)
 {
+    // a zone enters the map once it is ready
+    if (ZoneMap::isMapped(*shape)) zoneMapDirty = true;
     createNotifs.broadcast(shape);
 }
 
@@ -514,8 +1023,10 @@ void Canvas::processNewShape()
     StatusMsgGrd(*this);
     activeShape = shapes.back();
     activeShape->setCanvas(*this);
+    shapeIndex.insert(activeShape);
+    indexIds(activeShape);
+    setDirty(*activeShape);
     if (activeShape->isReady()) broadcastCreate(activeShape.get());
-    isDirty = true;
 }
 
 std::string Canvas::getDefaultStatusMsg() const
@@ -531,92 +1042,128 @@ bool Canvas::getOn() const
 void Canvas::setOn(bool value)
 {
     on = value;
+    fullDamage = true;
 }
 
-void Canvas::writeShapesToFile(const string &filepath) const
+const char *Canvas::BINARY_FILE_EXTENSION = ".ccvb";
+
+static bool isBinaryFile(const string &filepath)
 {
+    size_t size = strlen(Canvas::BINARY_FILE_EXTENSION);
+    return filepath.size() >= size &&
+            filepath.compare(filepath.size() - size, size, Canvas::BINARY_FILE_EXTENSION) == 0;
+}
+
+bool Canvas::writeShapesToFile(const string &filepath) const
+{
+    if (isBinaryFile(filepath))
+    {
+        vector<uint8_t> data;
+        writeShapesToBuffer(data);
+        ofstream file(filepath, ios::binary | ios::trunc);
+        file.write((const char*)data.data(), data.size());
+        return (bool)file.flush();
+    }
     FileStorage fs(filepath, FileStorage::WRITE);
+    if (! fs.isOpened()) return false;
     fs << "CanvasShapes" << *this;
+    return true;
 }
 
-void Canvas::readShapesFromFile(const string &filepath)
+bool Canvas::readShapesFromFile(const string &filepath)
 {
+    if (isBinaryFile(filepath))
+    {
+        ifstream file(filepath, ios::binary);
+        if (! file) return false;
+        vector<uint8_t> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        return readShapesFromBuffer(data.data(), data.size());
+    }
     FileStorage fs(filepath, FileStorage::READ);
-    fs["CanvasShapes"] >> *this;
+    if (! fs.isOpened()) return false;
+    FileNode node = fs["CanvasShapes"];
+    string name;
+    vector<Shape*> shapesRead;
+    if (node.empty() || ! readShapes(node, name, shapesRead)) return false;
+    clearShapes();
+    winName = name;
+    placeReadShapes(shapesRead);
+    return true;
 }
 
-
-static void mouseCB(int event, int x, int y, int flags, void* userData) {
-    (void)flags;
-    Canvas *pCanvas=reinterpret_cast<Canvas*>(userData);
-    switch( event )
+void Canvas::writeShapesToJson(JsonWriter &out) const
+{
+    out.beginObject();
+    out.key("CanvasShapes");
+    out.beginObject();
+    out.field("winName", winName);
+    out.key("shapes");
+    out.beginArray();
+    for (auto &shape : shapes)
     {
-    case EVENT_LBUTTONDOWN:
-        pCanvas->onMousePress(Point(x,y));
-        break;
-    case EVENT_LBUTTONUP:
-        pCanvas->onMouseRelease(Point(x,y));
-        break;
-    case EVENT_MOUSEMOVE:
-        pCanvas->onMouseMove(Point(x,y));
-        break;
+        if (shape->isReady()) out.shape(*shape);
     }
+    out.endArray();
+    out.endObject();
+    out.endObject();
 }
 
-void Canvas::setMouseCallback()
+void Canvas::writeShapesToBuffer(vector<uint8_t> &out) const
 {
-    cv::setMouseCallback(winName, mouseCB, this);
+    BinaryWriter writer;
+    writer.str(winName);
+    uint64_t count = 0;
+    for (auto &shape : shapes)
+    {
+        if (shape->isReady()) ++count;
+    }
+    writer.varint(count);
+    for (auto &shape : shapes)
+    {
+        if (shape->isReady()) writer.shape(*shape);
+    }
+    writer.finish(out);
 }
 
-void Canvas::imshow(InputArray mat)
+bool Canvas::readShapesFromBuffer(const uint8_t *data, size_t size)
 {
-   cv::imshow(winName, mat);
+    string name;
+    vector<Shape*> shapesRead;
+    if (! readShapes(data, size, name, shapesRead)) return false;
+    clearShapes();
+    winName = name;
+    placeReadShapes(shapesRead);
+    return true;
 }
 
-int Canvas::waitKeyEx(int delay)
+bool Canvas::readShapes(const uint8_t *data, size_t size, string &name, vector<Shape*> &shapesRead)
 {
-    bool delayZero = false;
-    if (delay <= 0)
+    BinaryReader reader(data, size);
+    name = reader.str();
+    uint64_t count = reader.varint();
+    for (uint64_t i = 0; i < count && reader.ok(); ++i)
     {
-        delayZero = true;
-        delay = 1000/25.; // ~ 25 FPS
+        Shape *shape = reader.shape();
+        if (shape) shapesRead.push_back(shape);
     }
-    int key = -1;
-    auto start = std::chrono::high_resolution_clock::now();
-    Mat internalOut;
-    do
+    if (! reader.ok())
     {
-#if OPENCV_HAS_WAITKEYEX
-        key = cv::waitKeyEx(delay);
-#else
-        key = cv::waitKey(delay);
-#endif
-        consumeKey(key);
-        if (! delayZero)
-        {   // check timeout on delay
-            auto end = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double, std::milli> diff = end-start;
-            if (diff.count() >= delay) break;
-        }
-        if (key == -1)
+        for (Shape *shape : shapesRead)
         {
-            if (on && (isDirty || hasDirtyWidgets()))
-            {
-                redrawOn(internalOut);
-                imshow(internalOut);
-            }
+            delete shape;
         }
-        else
-        {
-            break;
-        }
-    } while (true);
-    return key;
+        shapesRead.clear();
+        return false;
+    }
+    return true;
 }
 
+
 void Canvas::applyTheme(bool applyToCanvasText)
 {
     isDirty = true;
+    fullDamage = true;
+    overlayDirty = true;
     Theme *currentTheme = ThemeRepository::getCurrentTheme();
     for (auto &shape : shapes)
     {
@@ -633,16 +1180,289 @@ void Canvas::applyTheme(bool applyToCanvasText)
     }
 }
 
-void Canvas::fatal(string errorMsg, int exitStatus)
+void Canvas::setDirty()
 {
-    cerr << errorMsg << endl;
-    string header = "Fatal Error:\n";
-    MsgBox::createModal("Fatal Error", header + errorMsg , {"Exit"}, [exitStatus](Widget*,int) {_Exit(exitStatus);});
+    isDirty = true;
+    fullDamage = true;
+    overlayDirty = true;
 }
 
-void Canvas::setDirty()
+void Canvas::setDirty(const Rect &area)
 {
     isDirty = true;
+    addDamage(area);
+}
+
+void Canvas::setIncrementalRedraw(bool value)
+{
+    if (incrementalRedraw != value)
+    {
+        incrementalRedraw = value;
+        fullDamage = true;
+        if (! incrementalRedraw)
+        {
+            retainedOut.release();
+            damageScratch.release();
+        }
+    }
+}
+
+bool Canvas::getIncrementalRedraw() const
+{
+    return incrementalRedraw;
+}
+
+void Canvas::setRetainedOverlay(bool value)
+{
+    if (retainedOverlay != value)
+    {
+        retainedOverlay = value;
+        overlayDirty = true;
+        isDirty = true;
+        if (! retainedOverlay)
+        {
+            shapesOverlay.release();
+        }
+    }
+}
+
+bool Canvas::getRetainedOverlay() const
+{
+    return retainedOverlay;
+}
+
+void Canvas::setParallelRedraw(bool value, int tileSize)
+{
+    parallelRedraw = value;
+    parallelTileSize = max(tileSize, 16);
+}
+
+bool Canvas::getParallelRedraw() const
+{
+    return parallelRedraw;
+}
+
+void Canvas::setRenderThread(bool value)
+{
+    if (value == getRenderThread()) return;
+    if (value)
+    {
+        renderThread.reset(new RenderThread());
+    }
+    else
+    {
+        renderThread.reset();
+    }
+    setDirty();
+}
+
+bool Canvas::getRenderThread() const
+{
+    return (bool)renderThread;
+}
+
+void Canvas::redrawAsync(const Mat &src)
+{
+    if (! renderThread)
+    {
+        redrawOn(src, asyncOut);
+        asyncReady = true;
+        return;
+    }
+
+    latestFrameSrc = src;
+    shared_ptr<DrawList> list;
+    if (on)
+    {
+        if (hasStatusMsg)
+        {
+            statusMsg->setLocation(Point(5, src.rows - 5));
+        }
+
+        // Updating dirty widgets before recording them
+        updateDirtyWidgets();
+
+        // shapes may still look at the Mat they draw on, so they get one of the frame size
+        recordTarget.create(src.size(), CV_MAKETYPE(src.depth(), src.channels() == 1 ? 3 : src.channels()));
+        list = make_shared<DrawList>();
+        Painter::Recorder recorder(*list);
+        renderScene(recordTarget, vector<Rect>());
+    }
+    flushImmediateLayer();
+    clearDamage();
+    fullDamage = true; // nothing was retained for the incremental redraw
+    isDirty = false;
+
+    renderThread->submit(src.clone(), list);
+}
+
+bool Canvas::getRenderedFrame(Mat &dst)
+{
+    if (! renderThread)
+    {
+        if (! asyncReady) return false;
+        asyncReady = false;
+        dst = asyncOut;
+        return true;
+    }
+    return renderThread->fetch(dst);
+}
+
+void Canvas::recordFrame(DisplayList &list, const Size &frameSize)
+{
+    list.clear();
+    shapesDrawn = 0;
+    shapesCulled = 0;
+    if (! on)
+    {
+        flushImmediateLayer();
+        return;
+    }
+
+    if (hasStatusMsg)
+    {
+        statusMsg->setLocation(Point(5, frameSize.height - 5));
+    }
+
+    // Updating dirty widgets before recording them
+    updateDirtyWidgets();
+
+    // shapes may still look at the Mat they draw on, so they get one of the frame size
+    recordTarget.create(frameSize, CV_8UC3);
+    if (recordedSize != frameSize)
+    {   // the recordings are culled by the frame
+        recordedShapes.clear();
+        recordedStore.reset();
+        recordedSize = frameSize;
+    }
+
+    if (shapeStore)
+    {
+        if (! recordedStore)
+        {   // the store is read only, so its recording is kept
+            shared_ptr<DrawList> part = make_shared<DrawList>();
+            {
+                Painter::Recorder recorder(*part);
+                shapeStore->renderOn(recordTarget);
+            }
+            recordedStore = part;
+        }
+        list.append(recordedStore);
+    }
+
+    unordered_map<int, RecordedShape> recorded;
+    shapes.refresh();
+    for (size_t slot = 0; slot < shapes.getSlotCount(); ++slot)
+    {
+        if (! shapes.isVisible(slot) || cull(shapes.getBounds(slot), recordTarget)) continue;
+
+        const shared_ptr<Shape> &shape = shapes.getShape(slot);
+        RecordedShape &entry = recorded[shape->getId()];
+        auto prev = recordedShapes.find(shape->getId());
+        if (prev != recordedShapes.end() && prev->second.version == shape->getVersion())
+        {
+            entry = prev->second;
+        }
+        else
+        {
+            shared_ptr<DrawList> part = make_shared<DrawList>();
+            Painter::Recorder recorder(*part);
+            shape->draw(recordTarget);
+            entry.version = shape->getVersion();
+            entry.list = part;
+        }
+        list.append(entry.list);
+    }
+    recordedShapes.swap(recorded); // forget the shapes which are gone
+
+    shared_ptr<DrawList> overlays = make_shared<DrawList>();
+    {
+        Painter::Recorder recorder(*overlays);
+        renderOverlays(recordTarget, vector<Rect>());
+    }
+    list.append(overlays);
+    flushImmediateLayer();
+}
+
+void Canvas::publishFrame(const Mat &frame)
+{
+    frames.publish(frame);
+}
+
+bool Canvas::redrawLatestOn(Mat &dst)
+{
+    Mat frame;
+    if (! frames.take(frame)) return false;
+    redrawOn(frame, dst);
+    return true;
+}
+
+FrameMailbox::Stats Canvas::getFrameStats() const
+{
+    return frames.getStats();
+}
+
+Canvas::DrawStats Canvas::getDrawStats() const
+{
+    return {shapesDrawn.load(), shapesCulled.load()};
+}
+
+void Canvas::setProfiling(bool value, int window)
+{
+    if (! value)
+    {
+        profiler.reset();
+    }
+    else if (! profiler)
+    {
+        profiler.reset(new RenderProfiler(window));
+    }
+}
+
+bool Canvas::getProfiling() const
+{
+    return (bool)profiler;
+}
+
+const RenderProfiler *Canvas::getProfiler() const
+{
+    return profiler.get();
+}
+
+ImmediateLayer &Canvas::getImmediateLayer()
+{
+    isDirty = true;
+    return immediateLayer;
+}
+
+void Canvas::setShapeStore(const shared_ptr<ShapeStore> &value)
+{
+    shapeStore = value;
+    recordedStore.reset();
+    isDirty = true;
+    fullDamage = true;
+}
+
+const shared_ptr<ShapeStore> &Canvas::getShapeStore() const
+{
+    return shapeStore;
+}
+
+void Canvas::flushImmediateLayer()
+{
+    immediateDrawn = immediateLayer.getBounds();
+    immediateLayer.clear();
+}
+
+const ZoneMap &Canvas::getZoneMap()
+{
+    Size size = latestFrameSrc.empty() ? boundaries.size() : latestFrameSrc.size();
+    if (zoneMapDirty || zoneMap.getLabelImage().size() != size)
+    {
+        zoneMap.rebuild(shapes, size);
+        zoneMapDirty = false;
+    }
+    return zoneMap;
 }
 
 const Rect Canvas::getBoundaries() const
@@ -655,7 +1475,20 @@ Canvas::Canvas()
       isDirty(false),
       hasScreenText(false),
       hasStatusMsg(false),
-      dragPos(0,0)
+      dragPos(0,0),
+      incrementalRedraw(false),
+      fullDamage(true),
+      lastSrcData(nullptr),
+      lastDstData(nullptr),
+      retainedOverlay(false),
+      overlayDirty(true),
+      parallelRedraw(false),
+      parallelTileSize(256),
+      drawAreas(nullptr),
+      shapesDrawn(0),
+      shapesCulled(0),
+      asyncReady(false),
+      zoneMapDirty(true)
 {
 }
 
@@ -663,6 +1496,7 @@ void Canvas::setSize(const Size &value)
 {
     if (boundaries.size() != value)
     {
+        fullDamage = true;
         boundaries.width = value.width;
         boundaries.height = value.height;
         if (latestFrameSrc.size() != value)
@@ -703,31 +1537,97 @@ void write(FileStorage& fs, const std::string&, const Canvas& x)
     }
 }
 
+class Canvas::ParallelShapesRead : public ParallelLoopBody
+{
+public:
+    ParallelShapesRead(const vector<FileNode> &nodesVal, vector<Shape*> &shapesVal)
+        : nodes(nodesVal), shapes(shapesVal) {}
+
+    virtual void operator()(const Range &range) const
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            Shape *shape = 0;
+            nodes[i] >> shape;
+            shapes[i] = shape;
+        }
+    }
+
+private:
+    const vector<FileNode> &nodes;
+    vector<Shape*> &shapes;
+};
+
 void read(const FileNode& node, Canvas& x, const Canvas&)
 {
+    // like the binary format, shapes which can't be read leave the Canvas as it was
+    string name;
+    vector<Shape*> shapesRead;
+    if (! Canvas::readShapes(node, name, shapesRead)) return;
     x.clearShapes();
-    node["winName"] >> x.winName;
+    x.winName = name;
+    x.placeReadShapes(shapesRead);
+}
+
+bool Canvas::readShapes(const FileNode &node, string &name, vector<Shape*> &shapesRead)
+{
+    node["winName"] >> name;
+
+    // the top level shapes are independent until they are placed on the Canvas,
+    // so they are read in parallel
     FileNode n = node["shapes"];
-    FileNodeIterator it = n.begin(), it_end = n.end();
-    for (; it != it_end; )
-    { // ++it is done automatically by "it >> shape"
-        Shape *shape = 0;
-        it >> shape;
-        assert(shape != 0);
-        x.shapes.push_back(std::shared_ptr<Shape>(shape));
+    vector<FileNode> nodes;
+    for (FileNodeIterator it = n.begin(), it_end = n.end(); it != it_end; ++it)
+    {
+        nodes.push_back(*it);
+    }
+    shapesRead.assign(nodes.size(), nullptr);
+    parallel_for_(Range(0, (int)nodes.size()), ParallelShapesRead(nodes, shapesRead));
+
+    // an empty node reads as a null shape
+    if (find(shapesRead.begin(), shapesRead.end(), nullptr) != shapesRead.end())
+    {
+        for (Shape *shape : shapesRead)
+        {
+            delete shape;
+        }
+        shapesRead.clear();
+        return false;
+    }
+    return true;
+}
+
+void Canvas::placeReadShapes(const vector<Shape*> &shapesRead)
+{
+    idIndex.reserve(idIndex.size() + shapesRead.size());
+    vector<ShapesConnector*> connectors;
+    for (Shape *shape : shapesRead)
+    {
+        shapes.push_back(ShapePool::share(shape));
         shape->lostFocus();
-        shape->setCanvas(x);
+        shape->setCanvas(*this);
+        shapeIndex.insert(shapes.back());
+        indexIds(shapes.back());
+        ShapesConnector *connector = dynamic_cast<ShapesConnector*>(shape);
+        if (connector) connectors.push_back(connector);
     }
-    std::list<std::shared_ptr<ShapesConnector>> connectors;
-    x.getShapes(connectors);
-    for (auto &connector : connectors)
+
+    // all the ids are known now
+    for (ShapesConnector *connector : connectors)
     {
         connector->reconnect();
     }
-    for (auto &shape : x.shapes)
+
+    readNotifs.broadcast(shapesRead);
+    for (Shape *shape : shapesRead)
     {
-        x.broadcastCreate(shape.get());
+        broadcastCreate(shape);
     }
+    isDirty = true;
+    fullDamage = true;
+    overlayDirty = true;
+    zoneMapDirty = true;
+    recordedShapes.clear(); // the ids may be reused by the new shapes
 }
 
 shared_ptr<Widget> Canvas::rmvWidget(Widget *widget)
@@ -742,6 +1642,8 @@ shared_ptr<Widget> Canvas::rmvWidget(Widget *widget)
     if (i != widgets.end())
     {
         result = *i;
+        addDamage(widget->drawnRect);
+        widget->drawnRect = Rect();
         widgets.erase(i);
         rmvDirtyWidget(widget);
         if (widget == activeWidget.get())
@@ -758,6 +1660,7 @@ void Canvas::addWidget(const shared_ptr<Widget> &widget)
     widget->rmvFromLayout();
     widget->setLayout(*this);
     widgets.push_back(widget);
+    widget->damaged = true;
     isDirty = true;
 }
 
@@ -766,6 +1669,12 @@ shared_ptr<Widget> Canvas::rmvWidget(const shared_ptr<Widget> &widget)
     return rmvWidget(widget.get());
 }
 
+bool Canvas::addDirtyWidget(Widget *widget)
+{
+    widget->damaged = true;
+    return LayoutBase::addDirtyWidget(widget);
+}
+
 bool Canvas::setDirtyLayout()
 {
     isDirty = true;
@@ -4,23 +4,37 @@
 #include "canvascv/colors.h"
 #include "canvascv/consts.h"
 #include "canvascv/utils.h"
+#include "canvascv/displaylist.h"
+#include "canvascv/framemailbox.h"
+#include "canvascv/immediatelayer.h"
+#include "canvascv/renderprofiler.h"
+#include "canvascv/shapeindex.h"
+#include "canvascv/shapeslotmap.h"
+#include "canvascv/shapestore.h"
+#include "canvascv/zonemap.h"
 
 #include "shapes/shape.h"
+#include "shapes/jsonwriter.h"
 #include "widgets/widget.h"
 #include "shapes/shapefactory.h"
 #include "widgets/widgetfactory.h"
 #include "widgets/text.h"
 #include "widgets/layoutbase.h"
 
+#include <atomic>
 #include <list>
 #include <memory>
 #include <functional>
 #include <sstream>
+#include <unordered_map>
+#include <vector>
 
 /// This namespace holds all the classes of the CanvasCV library
 namespace canvascv
 {
 
+class RenderThread;
+
 /**
  * @brief The Canvas class is the entry point into CanvasCV
  * 
@@ -34,6 +48,7 @@ namespace canvascv
 class Canvas : public LayoutBase
 {
     typedef Dispathcer<Shape*> ShapeDispathcer;
+    typedef Dispathcer<const std::vector<Shape*>&> ShapesDispathcer;
 public:
     /// CB for notification on shapes create/modify/delete from this Canvas instance
     typedef ShapeDispathcer::CBType CBCanvasShape;
@@ -41,6 +56,12 @@ public:
     /// CBID for notification on shapes create/modify/delete from this Canvas instance
     typedef ShapeDispathcer::CBID CBIDCanvasShape;
 
+    /// CB for notification on all the shapes read into this Canvas instance at once
+    typedef ShapesDispathcer::CBType CBCanvasShapes;
+
+    /// CBID for notification on all the shapes read into this Canvas instance at once
+    typedef ShapesDispathcer::CBID CBIDCanvasShapes;
+
     /**
      * @brief Canvas
      * 
@@ -60,7 +81,7 @@ public:
      * Draws src with shapes and widgets onto dst. src is upgraded to 3 channels if it has 1 channel.
      * @param src can be also dst, in which case it is drawn on. src is BGR/BGRA/GRAY.
      * @param dst if different than src, then src is cloned to it and drawn on.
-     * @sa setImage
+     * @sa setImage setIncrementalRedraw
      */
     void redrawOn(const cv::Mat &src, cv::Mat &dst);
 
@@ -92,6 +113,16 @@ public:
     /// You should delegate OpenCV mouse callback events to this method
     void onMouseMove(const cv::Point &pos);
 
+    /**
+     * @brief processKey
+     *
+     * Let the active shape use a key press. This is what waitKeyEx() does with keys, and it
+     * can be used to feed keys from other sources (e.g. without a window).
+     * @param key is the key value
+     * @return -1 if the key was consumed, or the key otherwise
+     */
+    int processKey(int key);
+
     /**
      * @brief createShape
      * 
@@ -208,6 +239,24 @@ public:
      */
     void rmvNotifyOnShapeDelete(CBIDCanvasShape cbid);
 
+    /**
+     * @brief used to register for a notification on all the shapes read from a file at once
+     *
+     * Reading shapes (readShapesFromFile() and the other read methods) calls cb once with
+     * all the shapes read, before the notifyOnShapeCreate() CBs are called per shape. It
+     * suits code which would rather rebuild its state once than update it per shape.
+     * @param cb to invoke after shapes were read
+     * @return an id to use in rmvNotifyOnShapesRead()
+     */
+    CBIDCanvasShapes notifyOnShapesRead(CBCanvasShapes cb);
+
+    /**
+     * @brief used to unregister for notifications on shapes read
+     *
+     * @param cbid id returned previously from notifyOnShapesRead()
+     */
+    void rmvNotifyOnShapesRead(CBIDCanvasShapes cbid);
+
     /**
      * @brief clear all shapes from Canvas
      *
@@ -320,16 +369,50 @@ public:
     /// redrawOn will do nothing if value is 'false'
     void setOn(bool value);
 
-    /// write all the shapes currently in the Canvas to a file
-    void writeShapesToFile(const std::string &filepath) const;
+    /// the file extension of the compact binary format (see writeShapesToFile())
+    static const char *BINARY_FILE_EXTENSION;
+
+    /**
+     * @brief write all the shapes currently in the Canvas to a file
+     *
+     * The format is selected by the file extension: BINARY_FILE_EXTENSION (".ccvb") writes
+     * the compact binary format of writeShapesToBuffer(), and anything else is written by
+     * cv::FileStorage (XML, YAML or JSON). Both formats hold the same fields, and converting
+     * between them is exact.
+     * @return false if the file couldn't be written
+     */
+    bool writeShapesToFile(const std::string &filepath) const;
+
+    /**
+     * @brief load all the shapes from a file into the canvas (removing all current shapes in the process)
+     *
+     * @return false (and the Canvas is left as it was) if the file can't be opened, or its
+     * shapes can't be read
+     */
+    bool readShapesFromFile(const std::string &filepath);
+
+    /// append all the shapes currently in the Canvas to 'out' in the compact binary format
+    void writeShapesToBuffer(std::vector<uint8_t> &out) const;
+
+    /**
+     * @brief load shapes written by writeShapesToBuffer() (removing all current shapes in the process)
+     *
+     * @return false (and the Canvas is left as it was) if the data isn't valid
+     */
+    bool readShapesFromBuffer(const uint8_t *data, size_t size);
 
-    /// load all the from a file into the canvas (removing all current shapes in the process)
-    void readShapesFromFile(const std::string &filepath);
+    /**
+     * @brief stream all the shapes currently in the Canvas as json
+     *
+     * The document is the one writeShapesToFile() writes to a ".json" file, so it can be
+     * read back by readShapesFromFile().
+     */
+    void writeShapesToJson(JsonWriter &out) const;
 
-    /// utility method to handle mouse events on the associated window
+    /// utility method to handle mouse events on the associated window (only in the canvascv library)
     void setMouseCallback();
 
-    /// utility method which uses the winName encapsulated in Canvas
+    /// utility method which uses the winName encapsulated in Canvas (only in the canvascv library)
     void imshow(InputArray mat);
 
     /**
@@ -344,6 +427,7 @@ public:
      * When using widgets with callback on the same image, the delay should be 0.
      * If you're changing frames or using only the polling API of the widgets, then
      * specify a delay of your choice.
+     * This uses highgui, so it is only in the canvascv library (and not in canvascv_core).
      */
     int waitKeyEx(int delay = 0);
 
@@ -364,17 +448,211 @@ public:
      * - The errorMsg will also be written to the standard error
      * @param errorMsg will be displayed to the user
      * @param exitStatus will be used with _Exit()
+     * @note only in the canvascv library (it uses highgui)
      */
     static void fatal(string errorMsg, int exitStatus);
 
-    /// while waiting for events the Canvas is redrawn only if it is dirty
+    /// while waiting for events the Canvas is redrawn only if it is dirty (this redraws everything)
     void setDirty();
 
+    /// mark only 'area' as needing a redraw (e.g. the pixels of the src image changed there)
+    void setDirty(const cv::Rect &area);
+
+    /**
+     * @brief setIncrementalRedraw
+     *
+     * When enabled, redrawOn(src, dst) keeps the previous output and only redraws the areas
+     * touched by shapes and widgets which changed since the last call. If nothing changed,
+     * the previous output is reused as is.
+     * @param value is false by default
+     * @note
+     * Changes in the pixels of src are not detected if src is the same buffer of the same size
+     * and type as in the previous call. Use setImage() or setDirty() when reusing a buffer for
+     * a new frame. The incremental path is not used if src and dst are the same Mat.
+     */
+    void setIncrementalRedraw(bool value);
+
+    /// is the incremental redraw on/off?
+    bool getIncrementalRedraw() const;
+
+    /**
+     * @brief setRetainedOverlay
+     *
+     * When enabled, the shapes are rasterized once into a cached overlay which is blended
+     * onto each frame in redrawOn(). The overlay is rasterized again only when a shape is
+     * created, modified or deleted, so for live video the per frame cost of the shapes is
+     * a single blend instead of drawing all of them again.
+     * @param value is false by default
+     * @note
+     * The overlay is used only for 8 bit BGR/GRAY frames. Shapes changed without their
+     * setters (e.g. from inside a derived shape) should be followed by setDirty().
+     */
+    void setRetainedOverlay(bool value);
+
+    /// is the retained shapes overlay on/off?
+    bool getRetainedOverlay() const;
+
+    /**
+     * @brief setParallelRedraw
+     *
+     * When enabled, shapes are drawn on all cores. The frame is split into square tiles and
+     * shapes which don't share any tile are drawn at the same time, while shapes sharing a
+     * tile are still drawn by their order. The result is identical to the serial drawing.
+     * @param value is false by default
+     * @param tileSize is the width and height of the tiles in pixels
+     * @note
+     * Custom shapes must not change any state in draw() and must return a correct
+     * Shape::getBoundingRect() to benefit from this (the default bounds are drawn alone).
+     */
+    void setParallelRedraw(bool value, int tileSize = 256);
+
+    /// are shapes drawn in parallel?
+    bool getParallelRedraw() const;
+
+    /**
+     * @brief setRenderThread
+     *
+     * When enabled, frames are rendered on a separate thread, so a slow frame doesn't delay
+     * the handling of the mouse and keyboard. The scene is recorded on the calling thread
+     * into a DrawList, which is all the render thread uses. waitKeyEx() then only records
+     * changes and shows the latest rendered frame.
+     * @param value is false by default
+     * @note
+     * Custom shapes must draw through the Painter to be shown with the render thread.
+     */
+    void setRenderThread(bool value);
+
+    /// are frames rendered on a separate thread?
+    bool getRenderThread() const;
+
+    /**
+     * @brief redrawAsync
+     *
+     * Like redrawOn(), but the drawing is done by the render thread. Use getRenderedFrame()
+     * (or waitKeyEx()) to get the result. Without a render thread it is drawn right away.
+     * @param src is the frame to draw on (copied, so it can be reused)
+     */
+    void redrawAsync(const cv::Mat &src);
+
+    /**
+     * @brief getRenderedFrame
+     *
+     * @param dst will reference the latest rendered frame, which stays valid until the next call
+     * @return false if nothing new was rendered since the last call
+     */
+    bool getRenderedFrame(cv::Mat &dst);
+
+    /**
+     * @brief recordFrame
+     *
+     * Record what redrawOn() would draw over a frame of 'frameSize' (everything but the frame
+     * itself) into a DisplayList, which can then be replayed on any number of frames.
+     * Shapes which didn't change since the previous recordFrame() reuse their recording,
+     * so DisplayList::replayChangesOn() redraws only the changed shapes.
+     * @param list is cleared and filled with the recording
+     * @param frameSize is the size of the frames it will be replayed on
+     * @note
+     * Like a redraw, this consumes the immediate layer.
+     */
+    void recordFrame(DisplayList &list, const cv::Size &frameSize);
+
+    /**
+     * @brief publishFrame
+     *
+     * Hand a new frame to the Canvas from another thread (e.g. a capture thread), without
+     * blocking. Only the newest frame is kept: waitKeyEx() or redrawLatestOn() take it, and
+     * frames replaced before that are dropped.
+     * @param frame is copied, so it can be reused right away
+     * @note
+     * Only one thread may publish frames.
+     */
+    void publishFrame(const cv::Mat &frame);
+
+    /**
+     * @brief redrawLatestOn
+     *
+     * redrawOn() the newest published frame (see publishFrame())
+     * @param dst will hold the drawing
+     * @return false if no frame was published since the last time
+     */
+    bool redrawLatestOn(cv::Mat &dst);
+
+    /// published and dropped frame counters of publishFrame()
+    FrameMailbox::Stats getFrameStats() const;
+
+    /// shapes (sub shapes included) drawn and culled by the last drawing of the shapes
+    struct DrawStats
+    {
+        unsigned drawn;   ///< visible shapes which were drawn
+        unsigned culled;  ///< visible shapes skipped, since they were out of the drawn area
+    };
+
+    /**
+     * @brief getDrawStats
+     *
+     * Shapes which are entirely outside of the destination frame (or of the areas redrawn by
+     * the incremental redraw) are not drawn at all. These are the counters of the last time
+     * the shapes were drawn (the retained overlay keeps them until it is drawn again).
+     * @return the drawn and culled counters
+     */
+    DrawStats getDrawStats() const;
+
+    /**
+     * @brief setProfiling
+     *
+     * When enabled, the phases of every redrawOn() are timed into the rolling histograms of
+     * a RenderProfiler. When disabled (the default) nothing is timed.
+     * @param value turns profiling on or off (off drops the collected timings)
+     * @param window is the amount of frames kept by the histograms
+     */
+    void setProfiling(bool value, int window = 120);
+
+    /// is profiling on?
+    bool getProfiling() const;
+
+    /// the timings collected since profiling was turned on (null if it is off)
+    const RenderProfiler *getProfiler() const;
+
+    /**
+     * @brief getImmediateLayer
+     *
+     * A layer of non interactive primitives (boxes, polylines, circles, labels and markers)
+     * for what changes every frame, like detections. Fill it before each redraw: it is drawn
+     * over the shapes and under the widgets, and cleared once the frame was drawn.
+     * @return the layer (and the Canvas is marked for redraw)
+     */
+    ImmediateLayer &getImmediateLayer();
+
+    /**
+     * @brief setShapeStore
+     *
+     * Draw the shapes of a read only ShapeStore under the shapes of the Canvas. Only the
+     * store shapes touching the frame are decoded, so huge annotation sets are cheap to show.
+     * recordFrame() records the store once, so call this again after reopening the store.
+     * @param value is the store to draw, or null to stop drawing it
+     */
+    void setShapeStore(const std::shared_ptr<ShapeStore> &value);
+
+    /// the store set by setShapeStore() (may be null)
+    const std::shared_ptr<ShapeStore> &getShapeStore() const;
+
+    /**
+     * @brief getZoneMap
+     *
+     * Get the label image of the zone shapes (Polygon, Rectangle and Ellipse), to classify
+     * points into zones with a single lookup. It is built on the first call and rebuilt
+     * only after a zone shape changed.
+     * @return the map, of the size of the latest frame
+     */
+    const ZoneMap &getZoneMap();
+
 protected:
     virtual void recalc() {}
 
     virtual std::shared_ptr<Widget> rmvWidget(Widget *widget);
 
+    virtual bool addDirtyWidget(Widget *widget);
+
 
     virtual const cv::Rect getBoundaries() const;
 
@@ -406,6 +684,79 @@ private:
     };
     friend class StatusMsgGrd;
 
+    /// marks the active shape and widget as damaged before and after an event
+    class DamageGrd
+    {
+    public:
+        DamageGrd(Canvas &val) : c(val)
+        {
+            c.damageActive();
+        }
+        ~DamageGrd()
+        {
+            c.damageActive();
+        }
+    private:
+        Canvas &c;
+    };
+    friend class DamageGrd;
+    friend class Shape;
+    friend class ShapeJournal;
+
+    /// called by shapes (only top level shapes get here)
+    void setDirty(Shape &shape);
+
+    /// add shape and all its sub shapes to idIndex
+    void indexIds(const std::shared_ptr<Shape> &shape);
+
+    /// remove shape and all its sub shapes from idIndex
+    void unindexIds(Shape &shape);
+
+    /// read the shapes written by writeShapesToBuffer() without placing them, see placeReadShapes()
+    static bool readShapes(const uint8_t *data, size_t size,
+                           std::string &name, std::vector<Shape*> &shapesRead);
+
+    /// the cv::FileStorage counterpart of readShapes(), false if a shape node is empty
+    static bool readShapes(const cv::FileNode &node, std::string &name, std::vector<Shape*> &shapesRead);
+
+    /**
+     * @brief place top level shapes which were just read after the current shapes
+     *
+     * The shapes are indexed first, and then the connectors are connected and the shapes
+     * are announced, in a single pass each.
+     */
+    void placeReadShapes(const std::vector<Shape*> &shapesRead);
+
+    void damageActive();
+
+    void addDamage(const cv::Rect &area);
+
+    /// move all the damage collected since the last redraw into damageRects, clipped and merged
+    void collectDamage(const cv::Size &frameSize);
+
+    void clearDamage();
+
+    /// draw shapes and widgets on dst, but only those touching one of 'areas' (all if empty)
+    void renderScene(cv::Mat &dst, const std::vector<cv::Rect> &areas);
+
+    /// draw the immediate layer, widgets and texts touching one of 'areas' (all if empty)
+    void renderOverlays(cv::Mat &dst, const std::vector<cv::Rect> &areas);
+
+    /// draw the shapes touching one of 'areas' (all if empty), in parallel if requested
+    void drawShapes(cv::Mat &dst, const std::vector<cv::Rect> &areas);
+
+    /// draws a group of shapes which don't share any tile
+    class ParallelShapesDraw;
+    class ParallelShapesRead;
+
+    /// true if shape can't touch the pixels being drawn on dst, and counts it in the draw stats
+    bool cull(const cv::Rect &bounds, const cv::Mat &dst);
+
+    void redrawIncrementalOn(const cv::Mat &src, cv::Mat &dst);
+
+    /// rasterize the shapes again into shapesOverlay, if they changed since the last time
+    void updateShapesOverlay(const cv::Size &frameSize);
+
     /**
      * @brief consumeKey takes a key value and tries to use it in a shape or widget
      * 
@@ -424,6 +775,9 @@ private:
 
     void processNewShape();
 
+    /// the immediate layer was drawn for this frame
+    void flushImmediateLayer();
+
     bool on;
     bool isDirty;
     cv::Rect boundaries;
@@ -436,13 +790,66 @@ private:
     cv::Point dragPos;
     cv::Mat latestFrameSrc;
     std::string winName;
-    std::list<std::shared_ptr<Shape>> shapes;
+    ShapeSlotMap shapes;
     std::list<std::shared_ptr<Widget>> widgets;
     std::shared_ptr<Shape> activeShape;
     std::shared_ptr<Widget> activeWidget;
     ShapeDispathcer createNotifs;
     ShapeDispathcer modifyNotifs;
     ShapeDispathcer deleteNotifs;
+    ShapesDispathcer readNotifs;
+    cv::Mat internalOut;
+
+    bool incrementalRedraw;
+    bool fullDamage;
+    std::vector<Shape*> damagedShapes;
+    std::vector<cv::Rect> damageRects;
+    cv::Mat retainedOut;
+    cv::Mat damageScratch;
+    const uchar *lastSrcData;
+    const uchar *lastDstData;
+
+    bool retainedOverlay;
+    bool overlayDirty;
+    cv::Mat shapesOverlay;
+    cv::Rect overlayBounds;
+
+    bool parallelRedraw;
+    int parallelTileSize;
+
+    // set while drawShapes() runs, for culling the sub shapes
+    const std::vector<cv::Rect> *drawAreas;
+    std::atomic<unsigned> shapesDrawn;
+    std::atomic<unsigned> shapesCulled;
+
+    std::unique_ptr<RenderThread> renderThread;
+    cv::Mat recordTarget;
+    cv::Mat asyncOut;
+    bool asyncReady;
+
+    FrameMailbox frames;
+
+    /// the recording of a top level shape, as of its version
+    struct RecordedShape
+    {
+        unsigned version;
+        std::shared_ptr<const DrawList> list;
+    };
+    std::unordered_map<int, RecordedShape> recordedShapes; // by shape id
+    std::shared_ptr<const DrawList> recordedStore;
+    cv::Size recordedSize;
+
+    ImmediateLayer immediateLayer;
+    std::shared_ptr<ShapeStore> shapeStore;
+
+    std::unique_ptr<RenderProfiler> profiler;
+    cv::Rect immediateDrawn; ///< the bounds of the immediate layer in the last frame
+
+    ShapeIndex shapeIndex;
+    std::unordered_map<int, std::weak_ptr<Shape>> idIndex;
+
+    ZoneMap zoneMap;
+    bool zoneMapDirty;
 
     friend void operator >> (const cv::FileNode& n, Canvas& value)
     {
@@ -456,7 +863,7 @@ private:
 template <class T>
 std::shared_ptr<T> Canvas::createShape(const cv::Point &pos)
 {
-    std::shared_ptr<T> shape(ShapeFactoryT<T>::newShape(pos));
+    std::shared_ptr<T> shape = ShapePool::share(ShapeFactoryT<T>::newShape(pos));
     shapes.push_back(shape);
     processNewShape();
     ((Shape*)shape.get())->setReady();
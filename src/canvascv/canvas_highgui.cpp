@@ -0,0 +1,121 @@
+#include "canvas.h"
+
+#include "widgets/msgbox.h"
+
+#include <opencv2/highgui.hpp>
+
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+using namespace cv;
+
+// The highgui bindings of the Canvas. These are built into the 'canvascv'
+// library, while the rest of the Canvas is in the headless 'canvascv_core'.
+
+namespace canvascv
+{
+
+static void mouseCB(int event, int x, int y, int flags, void* userData) {
+    (void)flags;
+    Canvas *pCanvas=reinterpret_cast<Canvas*>(userData);
+    switch( event )
+    {
+    case EVENT_LBUTTONDOWN:
+        pCanvas->onMousePress(Point(x,y));
+        break;
+    case EVENT_LBUTTONUP:
+        pCanvas->onMouseRelease(Point(x,y));
+        break;
+    case EVENT_MOUSEMOVE:
+        pCanvas->onMouseMove(Point(x,y));
+        break;
+    }
+}
+
+void Canvas::setMouseCallback()
+{
+    cv::setMouseCallback(winName, mouseCB, this);
+}
+
+void Canvas::imshow(InputArray mat)
+{
+   cv::imshow(winName, mat);
+}
+
+int Canvas::waitKeyEx(int delay)
+{
+    bool delayZero = false;
+    if (delay <= 0)
+    {
+        delayZero = true;
+        delay = 1000/25.; // ~ 25 FPS
+    }
+    int key = -1;
+    auto start = std::chrono::high_resolution_clock::now();
+    do
+    {
+#if OPENCV_HAS_WAITKEYEX
+        key = cv::waitKeyEx(delay);
+#else
+        key = cv::waitKey(delay);
+#endif
+        consumeKey(key);
+        if (key == -1)
+        {
+            if (frames.hasNew())
+            {   // the newest frame from publishFrame()
+                Mat frame;
+                frames.take(frame);
+                if (renderThread)
+                {
+                    redrawAsync(frame);
+                }
+                else
+                {
+                    redrawOn(frame, internalOut);
+                    imshow(internalOut);
+                }
+            }
+            if (renderThread)
+            {   // only record changes here, and show what the render thread finished
+                if (on && (isDirty || hasDirtyWidgets()))
+                {
+                    redrawAsync(latestFrameSrc);
+                }
+                if (getRenderedFrame(internalOut))
+                {
+                    imshow(internalOut);
+                }
+            }
+        }
+        if (! delayZero)
+        {   // check timeout on delay
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double, std::milli> diff = end-start;
+            if (diff.count() >= delay) break;
+        }
+        if (key == -1)
+        {
+            if (! renderThread && on && (isDirty || hasDirtyWidgets()))
+            {
+                redrawOn(internalOut);
+                imshow(internalOut);
+            }
+        }
+        else
+        {
+            break;
+        }
+    } while (true);
+    return key;
+}
+
+void Canvas::fatal(string errorMsg, int exitStatus)
+{
+    cerr << errorMsg << endl;
+    string header = "Fatal Error:\n";
+    MsgBox::createModal("Fatal Error", header + errorMsg , {"Exit"}, [exitStatus](Widget*,int) {_Exit(exitStatus);});
+}
+
+}
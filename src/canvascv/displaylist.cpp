@@ -0,0 +1,241 @@
+#include "displaylist.h"
+#include "canvascv/utils.h"
+
+#include <cstring>
+#include <unordered_set>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+static const char LAYOUT_TAG[4] = {'C', 'C', 'D', 'S'};
+
+// above this amount of separate damaged areas the whole frame is replayed
+static const size_t MAX_DAMAGE_RECTS = 32;
+
+typedef shared_ptr<const DrawList> Part;
+
+// damage the parts of 'parts' which aren't in 'others', and return the rest by order
+static void diffParts(const vector<Part> &parts, const vector<Part> &others,
+                      vector<const DrawList*> &common, vector<Rect> &damage)
+{
+    unordered_set<const DrawList*> otherParts;
+    for (auto &part : others)
+    {
+        otherParts.insert(part.get());
+    }
+    for (auto &part : parts)
+    {
+        if (otherParts.count(part.get()))
+        {
+            common.push_back(part.get());
+        }
+        else
+        {
+            damage.push_back(part->getBounds());
+        }
+    }
+}
+
+// clip to the frame and merge overlapping rects, false if it isn't worth it
+static bool mergeDamage(vector<Rect> &damage, const Size &frameSize)
+{
+    const Rect frame(Point(0, 0), frameSize);
+    vector<Rect> merged;
+    int totalArea = 0;
+    for (Rect rect : damage)
+    {
+        rect &= frame;
+        if (rect.area() == 0) continue;
+        bool grew = true;
+        while (grew)
+        {
+            grew = false;
+            for (auto i = merged.begin(); i != merged.end(); ++i)
+            {
+                if (rectsIntersect(*i, rect))
+                {
+                    rect = rectUnion(*i, rect);
+                    merged.erase(i);
+                    grew = true;
+                    break;
+                }
+            }
+        }
+        merged.push_back(rect);
+    }
+    for (auto &rect : merged)
+    {
+        totalArea += rect.area();
+    }
+    damage.swap(merged);
+    return damage.size() <= MAX_DAMAGE_RECTS && totalArea * 2 <= frame.area();
+}
+
+class DisplayList::ParallelReplay : public ParallelLoopBody
+{
+public:
+    ParallelReplay(const DisplayList &listVal, vector<Mat> &dstsVal)
+        : list(listVal), dsts(dstsVal) {}
+
+    virtual void operator()(const Range &range) const
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            list.replayOn(dsts[i]);
+        }
+    }
+
+private:
+    const DisplayList &list;
+    vector<Mat> &dsts;
+};
+
+void DisplayList::clear()
+{
+    parts.clear();
+}
+
+void DisplayList::append(const shared_ptr<const DrawList> &part)
+{
+    parts.push_back(part);
+}
+
+const vector<shared_ptr<const DrawList>> &DisplayList::getParts() const
+{
+    return parts;
+}
+
+bool DisplayList::empty() const
+{
+    for (auto &part : parts)
+    {
+        if (! part->empty()) return false;
+    }
+    return true;
+}
+
+void DisplayList::replayOn(Mat &dst) const
+{
+    for (auto &part : parts)
+    {
+        part->replayOn(dst);
+    }
+}
+
+void DisplayList::replayOn(vector<Mat> &dsts) const
+{
+    parallel_for_(Range(0, (int)dsts.size()), ParallelReplay(*this, dsts));
+}
+
+void DisplayList::replayChangesOn(Mat &dst, const Mat &background, const DisplayList &previous,
+                                  vector<Rect> &damage) const
+{
+    damage.clear();
+    if (dst.size() != background.size() || dst.type() != background.type())
+    {
+        background.copyTo(dst);
+        replayOn(dst);
+        damage.push_back(Rect(Point(0, 0), dst.size()));
+        return;
+    }
+
+    vector<const DrawList*> common, prevCommon;
+    diffParts(parts, previous.parts, common, damage);
+    diffParts(previous.parts, parts, prevCommon, damage);
+    // parts in both lists which changed their drawing order (duplicates are compared by position)
+    for (size_t i = 0; i < common.size() && i < prevCommon.size(); ++i)
+    {
+        if (common[i] != prevCommon[i])
+        {
+            damage.push_back(common[i]->getBounds());
+            damage.push_back(prevCommon[i]->getBounds());
+        }
+    }
+
+    if (! mergeDamage(damage, dst.size()))
+    {
+        background.copyTo(dst);
+        replayOn(dst);
+        damage.assign(1, Rect(Point(0, 0), dst.size()));
+        return;
+    }
+    if (damage.empty()) return;
+
+    // parts are drawn in frame coordinates, so they are drawn on a full size scratch
+    // and only the damaged areas are taken from it
+    static thread_local Mat scratch;
+    scratch.create(dst.size(), dst.type());
+    for (auto &rect : damage)
+    {
+        Mat scratchROI = scratch(rect);
+        background(rect).copyTo(scratchROI);
+    }
+    for (auto &part : parts)
+    {
+        Rect bounds = part->getBounds();
+        for (auto &rect : damage)
+        {
+            if (rectsIntersect(bounds, rect))
+            {
+                part->replayOn(scratch);
+                break;
+            }
+        }
+    }
+    for (auto &rect : damage)
+    {
+        Mat dstROI = dst(rect);
+        scratch(rect).copyTo(dstROI);
+    }
+}
+
+void DisplayList::write(vector<uint8_t> &out) const
+{
+    uint32_t header[2] = {LAYOUT_VERSION, (uint32_t)parts.size()};
+    out.insert(out.end(), LAYOUT_TAG, LAYOUT_TAG + 4);
+    for (uint32_t value : header)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            out.push_back((uint8_t)(value >> (i * 8)));
+        }
+    }
+    for (auto &part : parts)
+    {
+        part->write(out);
+    }
+}
+
+bool DisplayList::read(const uint8_t *data, size_t size)
+{
+    clear();
+    const uint8_t *end = data + size;
+    if (size < 12 || memcmp(data, LAYOUT_TAG, 4) != 0) return false;
+    uint32_t header[2] = {0, 0};
+    for (int h = 0; h < 2; ++h)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            header[h] |= (uint32_t)data[4 + h * 4 + i] << (i * 8);
+        }
+    }
+    if (header[0] != LAYOUT_VERSION) return false;
+    data += 12;
+
+    for (uint32_t i = 0; i < header[1]; ++i)
+    {
+        shared_ptr<DrawList> part = make_shared<DrawList>();
+        if (! part->read(data, end))
+        {
+            clear();
+            return false;
+        }
+        parts.push_back(part);
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,86 @@
+#ifndef DISPLAYLIST_H
+#define DISPLAYLIST_H
+
+#include "canvascv/drawlist.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace canvascv
+{
+
+/**
+ * @brief The DisplayList class
+ *
+ * A recorded frame of a Canvas (see Canvas::recordFrame()), made of DrawList parts: one
+ * per top level shape and one for everything drawn over the shapes. It can be replayed
+ * on any number of frames without walking the shapes and widgets again.
+ *
+ * Parts are shared and never modified: a shape which didn't change between 2 recordings
+ * keeps the same part, so comparing parts tells which of them changed. replayChangesOn()
+ * uses that to redraw only the areas of the parts which changed since the previous replay.
+ */
+class DisplayList
+{
+public:
+    /// drop all the parts
+    void clear();
+
+    /// add a part, drawn after all the parts already in the list
+    void append(const std::shared_ptr<const DrawList> &part);
+
+    /// the parts by their drawing order
+    const std::vector<std::shared_ptr<const DrawList>> &getParts() const;
+
+    /// true if there is nothing to draw
+    bool empty() const;
+
+    /// draw all the parts on dst
+    void replayOn(cv::Mat &dst) const;
+
+    /// draw all the parts on each of dsts, in parallel
+    void replayOn(std::vector<cv::Mat> &dsts) const;
+
+    /**
+     * @brief replay only what changed since 'previous' was replayed on dst
+     *
+     * The parts which are in only one of the lists, or whose drawing order changed, are
+     * damaged. Their areas are restored from background, and the parts touching them are
+     * redrawn, clipped to them. When most of the frame is damaged (or dst doesn't match
+     * background) it falls back to copying background and replaying all the parts.
+     * @param dst holds 'previous' replayed over background
+     * @param background is the frame without any list replayed on it
+     * @param previous is the list which was replayed last on dst
+     * @param damage is set to the areas of dst which were redrawn
+     */
+    void replayChangesOn(cv::Mat &dst, const cv::Mat &background, const DisplayList &previous,
+                         std::vector<cv::Rect> &damage) const;
+
+    /// the version of the binary layout written by write()
+    static const uint32_t LAYOUT_VERSION = 1;
+
+    /**
+     * @brief write
+     *
+     * Append the list in a little endian binary layout to 'out': a "CCDS" tag, the layout
+     * version and the amount of parts, followed by the parts (see DrawList::write()).
+     */
+    void write(std::vector<uint8_t> &out) const;
+
+    /**
+     * @brief read a list written by write()
+     *
+     * @return false (and the list is cleared) if the data isn't a valid list of this layout version
+     */
+    bool read(const uint8_t *data, size_t size);
+
+private:
+    class ParallelReplay;
+
+    std::vector<std::shared_ptr<const DrawList>> parts;
+};
+
+}
+
+#endif // DISPLAYLIST_H
@@ -0,0 +1,452 @@
+#include "drawlist.h"
+#include "painter.h"
+#include "canvascv/utils.h"
+
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+// the binary layout is little endian regardless of the machine
+static const char LAYOUT_TAG[4] = {'C', 'C', 'D', 'L'};
+
+static void putU32(vector<uint8_t> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out.push_back((uint8_t)(value >> (i * 8)));
+    }
+}
+
+static void putI32(vector<uint8_t> &out, int value)
+{
+    putU32(out, (uint32_t)value);
+}
+
+static void putF32(vector<uint8_t> &out, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    putU32(out, bits);
+}
+
+static void putF64(vector<uint8_t> &out, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    putU32(out, (uint32_t)bits);
+    putU32(out, (uint32_t)(bits >> 32));
+}
+
+namespace
+{
+
+/// reads the values written by the put functions, and fails once the data ends
+struct Reader
+{
+    const uint8_t *pos;
+    const uint8_t *end;
+    bool ok;
+
+    bool has(size_t size)
+    {
+        ok = ok && (size_t)(end - pos) >= size;
+        return ok;
+    }
+
+    uint32_t u32()
+    {
+        if (! has(4)) return 0;
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            value |= (uint32_t)pos[i] << (i * 8);
+        }
+        pos += 4;
+        return value;
+    }
+
+    int i32()
+    {
+        return (int)u32();
+    }
+
+    float f32()
+    {
+        uint32_t bits = u32();
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    double f64()
+    {
+        uint64_t bits = u32();
+        bits |= (uint64_t)u32() << 32;
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+};
+
+}
+
+void DrawList::clear()
+{
+    ops.clear();
+    texts.clear();
+    images.clear();
+    points.clear();
+    polylines.clear();
+    bounds = Rect();
+}
+
+bool DrawList::empty() const
+{
+    return ops.empty();
+}
+
+size_t DrawList::size() const
+{
+    return ops.size();
+}
+
+const vector<DrawList::Op> &DrawList::getOps() const
+{
+    return ops;
+}
+
+Rect DrawList::getBounds() const
+{
+    return bounds;
+}
+
+void DrawList::replayOn(Mat &dst) const
+{
+    for (auto &op : ops)
+    {
+        switch (op.kind)
+        {
+        case Op::LINE:
+            Painter::line(dst, op.pt1, op.pt2, op.color, op.thickness, op.lineType, op.shift);
+            break;
+        case Op::ARROWED_LINE:
+            Painter::arrowedLine(dst, op.pt1, op.pt2, op.color, op.thickness, op.lineType, op.shift, op.param);
+            break;
+        case Op::CIRCLE:
+            Painter::circle(dst, op.pt1, op.radius, op.color, op.thickness, op.lineType, op.shift);
+            break;
+        case Op::ELLIPSE:
+            Painter::ellipse(dst, op.box, op.color, op.thickness, op.lineType);
+            break;
+        case Op::RECTANGLE:
+            Painter::rectangle(dst, Rect(op.pt1, op.pt2), op.color, op.thickness, op.lineType, op.shift);
+            break;
+        case Op::TEXT:
+            Painter::putText(dst, texts[op.index], op.pt1, op.radius, op.param, op.color, op.thickness, op.lineType);
+            break;
+        case Op::IMAGE:
+        case Op::PREMULTIPLIED_IMAGE:
+            Painter::image(dst, images[op.index], op.pt1, op.kind == Op::PREMULTIPLIED_IMAGE, true);
+            break;
+        case Op::POLYLINES:
+        {
+            const int *info = &polylines[op.index];
+            Painter::polylines(dst, &points[info[0]], info + 2, info[1], op.param != 0,
+                               op.color, op.thickness, op.lineType, op.shift);
+            break;
+        }
+        case Op::MARKER:
+            Painter::marker(dst, op.pt1, op.color, op.index, op.radius, op.thickness, op.lineType);
+            break;
+        }
+    }
+}
+
+void DrawList::write(vector<uint8_t> &out) const
+{
+    out.insert(out.end(), LAYOUT_TAG, LAYOUT_TAG + 4);
+    putU32(out, LAYOUT_VERSION);
+    putU32(out, (uint32_t)ops.size());
+    putU32(out, (uint32_t)texts.size());
+    putU32(out, (uint32_t)images.size());
+    putU32(out, (uint32_t)points.size());
+    putU32(out, (uint32_t)polylines.size());
+
+    for (auto &op : ops)
+    {
+        putU32(out, op.kind);
+        for (int i = 0; i < 4; ++i)
+        {
+            putF64(out, op.color[i]);
+        }
+        putI32(out, op.pt1.x);
+        putI32(out, op.pt1.y);
+        putI32(out, op.pt2.x);
+        putI32(out, op.pt2.y);
+        putF32(out, op.box.center.x);
+        putF32(out, op.box.center.y);
+        putF32(out, op.box.size.width);
+        putF32(out, op.box.size.height);
+        putF32(out, op.box.angle);
+        putF64(out, op.param);
+        putI32(out, op.radius);
+        putI32(out, op.thickness);
+        putI32(out, op.lineType);
+        putI32(out, op.shift);
+        putI32(out, op.index);
+    }
+    for (auto &text : texts)
+    {
+        putU32(out, (uint32_t)text.size());
+        out.insert(out.end(), text.begin(), text.end());
+    }
+    for (auto &image : images)
+    {
+        putI32(out, image.rows);
+        putI32(out, image.cols);
+        putI32(out, image.type());
+        size_t rowSize = image.cols * image.elemSize();
+        for (int r = 0; r < image.rows; ++r)
+        {
+            const uint8_t *row = image.ptr<uint8_t>(r);
+            out.insert(out.end(), row, row + rowSize);
+        }
+    }
+    for (auto &pt : points)
+    {
+        putI32(out, pt.x);
+        putI32(out, pt.y);
+    }
+    for (int value : polylines)
+    {
+        putI32(out, value);
+    }
+}
+
+bool DrawList::read(const uint8_t *&data, const uint8_t *end)
+{
+    clear();
+    Reader in = {data, end, true};
+    if (! in.has(4) || memcmp(in.pos, LAYOUT_TAG, 4) != 0) return false;
+    in.pos += 4;
+    if (in.u32() != LAYOUT_VERSION) return false;
+    uint32_t opCount = in.u32();
+    uint32_t textCount = in.u32();
+    uint32_t imageCount = in.u32();
+    uint32_t pointCount = in.u32();
+    uint32_t polylinesCount = in.u32();
+
+    for (uint32_t i = 0; i < opCount && in.ok; ++i)
+    {
+        Op op;
+        uint32_t kind = in.u32();
+        if (kind > Op::MARKER) in.ok = false;
+        op.kind = (Op::Kind)kind;
+        for (int c = 0; c < 4; ++c)
+        {
+            op.color[c] = in.f64();
+        }
+        op.pt1.x = in.i32();
+        op.pt1.y = in.i32();
+        op.pt2.x = in.i32();
+        op.pt2.y = in.i32();
+        op.box.center.x = in.f32();
+        op.box.center.y = in.f32();
+        op.box.size.width = in.f32();
+        op.box.size.height = in.f32();
+        op.box.angle = in.f32();
+        op.param = in.f64();
+        op.radius = in.i32();
+        op.thickness = in.i32();
+        op.lineType = in.i32();
+        op.shift = in.i32();
+        op.index = in.i32();
+        ops.push_back(op);
+    }
+    for (uint32_t i = 0; i < textCount && in.ok; ++i)
+    {
+        uint32_t size = in.u32();
+        if (! in.has(size)) break;
+        texts.push_back(string((const char*)in.pos, size));
+        in.pos += size;
+    }
+    for (uint32_t i = 0; i < imageCount && in.ok; ++i)
+    {
+        int rows = in.i32();
+        int cols = in.i32();
+        int type = in.i32();
+        if (rows < 0 || cols < 0) in.ok = false;
+        size_t rowSize = (size_t)cols * CV_ELEM_SIZE(type);
+        if (! in.has(rowSize * rows)) break;
+        Mat image(rows, cols, type);
+        for (int r = 0; r < rows; ++r)
+        {
+            memcpy(image.ptr<uint8_t>(r), in.pos, rowSize);
+            in.pos += rowSize;
+        }
+        images.push_back(image);
+    }
+    for (uint32_t i = 0; i < pointCount && in.ok; ++i)
+    {
+        int x = in.i32();
+        points.push_back(Point(x, in.i32()));
+    }
+    for (uint32_t i = 0; i < polylinesCount && in.ok; ++i)
+    {
+        polylines.push_back(in.i32());
+    }
+
+    // the indices must be valid for replayOn()
+    for (size_t i = 0; i < ops.size() && in.ok; ++i)
+    {
+        const Op &op = ops[i];
+        switch (op.kind)
+        {
+        case Op::TEXT:
+            in.ok = op.index >= 0 && op.index < (int)texts.size();
+            break;
+        case Op::IMAGE:
+        case Op::PREMULTIPLIED_IMAGE:
+            in.ok = op.index >= 0 && op.index < (int)images.size();
+            break;
+        case Op::POLYLINES:
+        {
+            in.ok = op.index >= 0 && op.index + 2 <= (int)polylines.size();
+            if (! in.ok) break;
+            int64_t first = polylines[op.index], contours = polylines[op.index + 1];
+            in.ok = first >= 0 && contours >= 0 && op.index + 2 + contours <= (int64_t)polylines.size();
+            int64_t last = first;
+            for (int c = 0; in.ok && c < contours; ++c)
+            {
+                int count = polylines[op.index + 2 + c];
+                in.ok = count >= 0;
+                last += count;
+            }
+            in.ok = in.ok && last <= (int64_t)points.size();
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    if (! in.ok)
+    {
+        clear();
+        return false;
+    }
+    for (auto &op : ops)
+    {
+        bounds = rectUnion(bounds, getOpBounds(op));
+    }
+    data = in.pos;
+    return true;
+}
+
+void DrawList::add(const Op &op)
+{
+    ops.push_back(op);
+    bounds = rectUnion(bounds, getOpBounds(op));
+}
+
+Rect DrawList::getOpBounds(const Op &op) const
+{
+    // points of the shifted primitives have 'shift' fractional bits
+    int shift = (op.shift > 0 && op.shift < 31) ? op.shift : 0;
+    Point pt1(op.pt1.x >> shift, op.pt1.y >> shift);
+    Point pt2(op.pt2.x >> shift, op.pt2.y >> shift);
+    int pad = max(op.thickness, 1) / 2 + 2; // +2 for LINE_AA
+    Rect rect;
+    switch (op.kind)
+    {
+    case Op::LINE:
+    case Op::RECTANGLE:
+        rect = Rect(min(pt1.x, pt2.x), min(pt1.y, pt2.y),
+                    abs(pt1.x - pt2.x) + 1, abs(pt1.y - pt2.y) + 1);
+        break;
+    case Op::ARROWED_LINE:
+        rect = Rect(min(pt1.x, pt2.x), min(pt1.y, pt2.y),
+                    abs(pt1.x - pt2.x) + 1, abs(pt1.y - pt2.y) + 1);
+        // the tip may stick out of the line by up to its length
+        pad += (int)ceil(hypot(pt2.x - pt1.x, pt2.y - pt1.y) * op.param);
+        break;
+    case Op::CIRCLE:
+    {
+        int radius = op.radius >> shift;
+        rect = Rect(pt1.x - radius, pt1.y - radius, radius * 2 + 1, radius * 2 + 1);
+        break;
+    }
+    case Op::ELLIPSE:
+        rect = op.box.boundingRect();
+        break;
+    case Op::TEXT:
+    {
+        int baseline = 0;
+        Size size = getTextSize(texts[op.index], op.radius, op.param, op.thickness, &baseline);
+        rect = Rect(pt1.x, pt1.y - size.height, size.width, size.height + baseline);
+        break;
+    }
+    case Op::IMAGE:
+    case Op::PREMULTIPLIED_IMAGE:
+        rect = Rect(op.pt1, images[op.index].size());
+        pad = 0;
+        break;
+    case Op::POLYLINES:
+    {
+        const int *info = &polylines[op.index];
+        int count = 0;
+        for (int c = 0; c < info[1]; ++c)
+        {
+            count += info[2 + c];
+        }
+        if (! count) return Rect();
+        Point tl(INT_MAX, INT_MAX), br(INT_MIN, INT_MIN);
+        for (int i = info[0]; i < info[0] + count; ++i)
+        {
+            Point pt(points[i].x >> shift, points[i].y >> shift);
+            tl = Point(min(tl.x, pt.x), min(tl.y, pt.y));
+            br = Point(max(br.x, pt.x), max(br.y, pt.y));
+        }
+        rect = Rect(tl.x, tl.y, br.x - tl.x + 1, br.y - tl.y + 1);
+        break;
+    }
+    case Op::MARKER:
+        rect = Rect(op.pt1.x - op.radius / 2, op.pt1.y - op.radius / 2, op.radius + 1, op.radius + 1);
+        break;
+    }
+    return padRect(rect, pad);
+}
+
+int DrawList::addText(const string &text)
+{
+    texts.push_back(text);
+    return (int)texts.size() - 1;
+}
+
+int DrawList::addImage(const Mat &image)
+{
+    images.push_back(image);
+    return (int)images.size() - 1;
+}
+
+int DrawList::addPolylines(const Point *pts, const int *counts, int contours)
+{
+    int index = (int)polylines.size();
+    polylines.push_back((int)points.size());
+    polylines.push_back(contours);
+    for (int i = 0; i < contours; ++i)
+    {
+        polylines.push_back(counts[i]);
+        points.insert(points.end(), pts, pts + counts[i]);
+        pts += counts[i];
+    }
+    return index;
+}
+
+}
@@ -0,0 +1,119 @@
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace canvascv
+{
+
+/**
+ * @brief The DrawList class
+ *
+ * A recording of the drawing done through the Painter. It owns copies of everything
+ * it needs (texts, points, images), so it can be replayed on any thread, after the
+ * shapes and widgets it was recorded from were changed or deleted.
+ *
+ * Use a Painter::Recorder to fill it and replayOn() to draw it.
+ */
+class DrawList
+{
+public:
+    /// one recorded drawing primitive
+    struct Op
+    {
+        enum Kind
+        {
+            LINE,
+            ARROWED_LINE,
+            CIRCLE,
+            ELLIPSE,
+            RECTANGLE,
+            TEXT,
+            IMAGE,
+            PREMULTIPLIED_IMAGE,
+            POLYLINES,
+            MARKER
+        };
+
+        Kind kind;
+        cv::Scalar color;
+        cv::Point pt1;       ///< start, center, top left, text origin, image or marker position
+        cv::Point pt2;       ///< end or bottom right
+        cv::RotatedRect box; ///< the ellipse
+        double param;        ///< tipLength, fontScale, or polylines closed (1) or not (0)
+        int radius;          ///< circle radius, marker size, or fontFace
+        int thickness;
+        int lineType;
+        int shift;
+        int index;           ///< into the texts, images or polylines of the list, or marker type
+    };
+
+    /// drop all the recorded operations
+    void clear();
+
+    /// true if nothing was recorded
+    bool empty() const;
+
+    /// the amount of recorded operations
+    size_t size() const;
+
+    /// all the recorded operations, by their drawing order
+    const std::vector<Op> &getOps() const;
+
+    /// a rect holding all the pixels the recorded operations may touch (empty if nothing was recorded)
+    cv::Rect getBounds() const;
+
+    /**
+     * @brief replayOn
+     *
+     * draw all the recorded operations on dst, by their recording order
+     * @param dst should be of the size and type of the Mat used while recording
+     */
+    void replayOn(cv::Mat &dst) const;
+
+    /// the version of the binary layout written by write()
+    static const uint32_t LAYOUT_VERSION = 1;
+
+    /**
+     * @brief write
+     *
+     * Append the list in a little endian binary layout to 'out': a "CCDL" tag, the layout
+     * version and the sizes of the tables, followed by the ops and the texts, images,
+     * points and polylines tables.
+     */
+    void write(std::vector<uint8_t> &out) const;
+
+    /**
+     * @brief read a list written by write()
+     *
+     * @param data is advanced past the list on success
+     * @param end is the end of the data
+     * @return false (and the list is cleared) if the data isn't a valid list of this layout version
+     */
+    bool read(const uint8_t *&data, const uint8_t *end);
+
+private:
+    friend class Painter;
+
+    void add(const Op &op);
+    cv::Rect getOpBounds(const Op &op) const;
+    int addText(const std::string &text);
+    int addImage(const cv::Mat &image);
+    int addPolylines(const cv::Point *points, const int *counts, int contours);
+
+    std::vector<Op> ops;
+    std::vector<std::string> texts;
+    std::vector<cv::Mat> images;
+    std::vector<cv::Point> points;
+    /// per POLYLINES op: the offset of its first point, the amount of contours, the points per contour
+    std::vector<int> polylines;
+    cv::Rect bounds;
+};
+
+}
+
+#endif // DRAWLIST_H
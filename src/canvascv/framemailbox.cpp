@@ -0,0 +1,53 @@
+#include "framemailbox.h"
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+FrameMailbox::FrameMailbox()
+    : writeSlot(0),
+      readSlot(1),
+      shared(2),
+      published(0),
+      dropped(0)
+{
+}
+
+void FrameMailbox::publish(const Mat &frame)
+{
+    frame.copyTo(slots[writeSlot]);
+    // release: the copy above is visible to whoever gets this slot
+    int prev = shared.exchange(writeSlot | FRESH, memory_order_acq_rel);
+    if (prev & FRESH)
+    {
+        dropped.fetch_add(1, memory_order_relaxed);
+    }
+    writeSlot = prev & ~FRESH;
+    published.fetch_add(1, memory_order_relaxed);
+}
+
+bool FrameMailbox::take(Mat &dst)
+{
+    if (! hasNew()) return false;
+    int prev = shared.exchange(readSlot, memory_order_acq_rel);
+    readSlot = prev & ~FRESH;
+    dst = slots[readSlot];
+    return true;
+}
+
+bool FrameMailbox::hasNew() const
+{
+    return (shared.load(memory_order_acquire) & FRESH) != 0;
+}
+
+FrameMailbox::Stats FrameMailbox::getStats() const
+{
+    Stats stats;
+    stats.published = published.load(memory_order_relaxed);
+    stats.dropped = dropped.load(memory_order_relaxed);
+    return stats;
+}
+
+}
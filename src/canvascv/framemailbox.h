@@ -0,0 +1,71 @@
+#ifndef FRAMEMAILBOX_H
+#define FRAMEMAILBOX_H
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+namespace canvascv
+{
+
+/**
+ * @brief The FrameMailbox class
+ *
+ * A lock free "latest frame wins" mailbox between a single producer thread (e.g. a capture
+ * loop) and a single consumer thread (the one drawing the Canvas). It is a triple buffer:
+ * the producer writes into its own slot and swaps it with the shared one, the consumer
+ * swaps the shared slot with its own to read. Neither side ever waits, and a frame which
+ * was not taken before the next one was published is dropped.
+ */
+class FrameMailbox
+{
+public:
+    /// frame counters since construction
+    struct Stats
+    {
+        uint64_t published; ///< frames given to publish()
+        uint64_t dropped;   ///< frames replaced by a newer one before they were taken
+    };
+
+    FrameMailbox();
+
+    /**
+     * @brief publish a new frame - call from the producer thread only
+     *
+     * @param frame is copied into the mailbox (its buffers are reused), so the caller
+     * can reuse frame right away
+     */
+    void publish(const cv::Mat &frame);
+
+    /**
+     * @brief take the newest frame - call from the consumer thread only
+     *
+     * @param dst will reference the frame, which stays valid until the next take()
+     * @return false if no frame was published since the last take()
+     */
+    bool take(cv::Mat &dst);
+
+    /// true if a frame was published since the last take()
+    bool hasNew() const;
+
+    Stats getStats() const;
+
+private:
+    FrameMailbox(const FrameMailbox&) = delete;
+    FrameMailbox &operator=(const FrameMailbox&) = delete;
+
+    /// marks the shared slot as holding a frame which was not taken yet
+    static const int FRESH = 4;
+
+    cv::Mat slots[3];
+    int writeSlot;           // owned by the producer
+    int readSlot;            // owned by the consumer
+    std::atomic<int> shared; // slot index | FRESH
+    std::atomic<uint64_t> published;
+    std::atomic<uint64_t> dropped;
+};
+
+}
+
+#endif // FRAMEMAILBOX_H
@@ -0,0 +1,197 @@
+#include "immediatelayer.h"
+#include "painter.h"
+#include "consts.h"
+#include "utils.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+// space between the label text and the edges of its background
+static const int LABEL_PADDING = 2;
+
+static bool sameStyle(const Scalar &color1, int thickness1, const Scalar &color2, int thickness2)
+{
+    return thickness1 == thickness2 && color1 == color2;
+}
+
+ImmediateLayer::ImmediateLayer()
+    : lineType(LINE_8)
+{
+}
+
+void ImmediateLayer::box(const Rect &rect, const Scalar &color, int thickness)
+{
+    if (thickness < 0)
+    {
+        fills.push_back({rect, color});
+        bounds = rectUnion(bounds, rect);
+        return;
+    }
+    Point corners[4] = {rect.tl(),
+                        Point(rect.x + rect.width - 1, rect.y),
+                        Point(rect.x + rect.width - 1, rect.y + rect.height - 1),
+                        Point(rect.x, rect.y + rect.height - 1)};
+    addPolyline(corners, 4, true, color, thickness);
+}
+
+void ImmediateLayer::polyline(const Point *pts, int count, bool closed, const Scalar &color, int thickness)
+{
+    if (count <= 0) return;
+    addPolyline(pts, count, closed, color, thickness);
+}
+
+void ImmediateLayer::polyline(const vector<Point> &pts, bool closed, const Scalar &color, int thickness)
+{
+    polyline(pts.data(), (int)pts.size(), closed, color, thickness);
+}
+
+void ImmediateLayer::circle(const Point &center, int radius, const Scalar &color, int thickness)
+{
+    circles.push_back({center, radius, color, thickness});
+    Rect rect(center.x - radius, center.y - radius, radius * 2 + 1, radius * 2 + 1);
+    bounds = rectUnion(bounds, padRect(rect, max(thickness, 0) / 2 + 2));
+}
+
+void ImmediateLayer::label(const string &txt, const Point &topLeft, const Scalar &color,
+                           const Scalar &bgColor, double fontScale, int thickness)
+{
+    int baseline = 0;
+    Size size = getTextSize(txt, Consts::DEFAULT_FONT, fontScale, thickness, &baseline);
+    Label lbl;
+    lbl.first = (int)chars.size();
+    lbl.length = (int)txt.size();
+    lbl.rect = Rect(topLeft, Size(size.width + LABEL_PADDING * 2,
+                                  size.height + baseline + LABEL_PADDING * 2));
+    lbl.org = Point(topLeft.x + LABEL_PADDING, topLeft.y + LABEL_PADDING + size.height);
+    lbl.color = color;
+    lbl.bgColor = bgColor;
+    lbl.fontScale = fontScale;
+    lbl.thickness = thickness;
+    chars += txt;
+    labels.push_back(lbl);
+    bounds = rectUnion(bounds, lbl.rect);
+}
+
+void ImmediateLayer::marker(const Point &pos, const Scalar &color, int markerType, int size, int thickness)
+{
+    markers.push_back({pos, color, markerType, size, thickness});
+    Rect rect(pos.x - size / 2, pos.y - size / 2, size + 1, size + 1);
+    bounds = rectUnion(bounds, padRect(rect, thickness / 2 + 2));
+}
+
+int ImmediateLayer::getLineType() const
+{
+    return lineType;
+}
+
+void ImmediateLayer::setLineType(int value)
+{
+    lineType = value;
+}
+
+void ImmediateLayer::clear()
+{
+    bounds = Rect();
+    points.clear();
+    polylines.clear();
+    fills.clear();
+    circles.clear();
+    markers.clear();
+    labels.clear();
+    chars.clear();
+}
+
+bool ImmediateLayer::empty() const
+{
+    return polylines.empty() && fills.empty() && circles.empty() && markers.empty() && labels.empty();
+}
+
+const Rect &ImmediateLayer::getBounds() const
+{
+    return bounds;
+}
+
+void ImmediateLayer::renderOn(Mat &dst) const
+{
+    for (auto &fill : fills)
+    {
+        Painter::rectangle(dst, fill.rect, fill.color, FILLED, lineType);
+    }
+
+    // sorted by style (and by index within a style), so each style is a single call
+    order.resize(polylines.size());
+    for (int i = 0; i < (int)order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [this](int a, int b)
+    {
+        const Polyline &pa = polylines[a], &pb = polylines[b];
+        if (pa.closed != pb.closed) return pa.closed < pb.closed;
+        if (pa.thickness != pb.thickness) return pa.thickness < pb.thickness;
+        for (int c = 0; c < 4; ++c)
+        {
+            if (pa.color[c] != pb.color[c]) return pa.color[c] < pb.color[c];
+        }
+        return a < b;
+    });
+    for (size_t i = 0; i < order.size(); )
+    {
+        const Polyline &style = polylines[order[i]];
+        batchPoints.clear();
+        batchCounts.clear();
+        for (; i < order.size(); ++i)
+        {
+            const Polyline &poly = polylines[order[i]];
+            if (poly.closed != style.closed ||
+                    ! sameStyle(poly.color, poly.thickness, style.color, style.thickness))
+            {
+                break;
+            }
+            batchPoints.insert(batchPoints.end(), points.begin() + poly.first,
+                               points.begin() + poly.first + poly.count);
+            batchCounts.push_back(poly.count);
+        }
+        Painter::polylines(dst, batchPoints.data(), batchCounts.data(), (int)batchCounts.size(),
+                           style.closed, style.color, style.thickness, lineType);
+    }
+
+    for (auto &c : circles)
+    {
+        Painter::circle(dst, c.center, c.radius, c.color, c.thickness, lineType);
+    }
+    for (auto &m : markers)
+    {
+        Painter::marker(dst, m.pos, m.color, m.type, m.size, m.thickness, lineType);
+    }
+    for (auto &lbl : labels)
+    {
+        Painter::rectangle(dst, lbl.rect, lbl.bgColor, FILLED, lineType);
+        text.assign(chars, lbl.first, lbl.length);
+        Painter::putText(dst, text, lbl.org, Consts::DEFAULT_FONT, lbl.fontScale, lbl.color,
+                         lbl.thickness, lineType);
+    }
+}
+
+void ImmediateLayer::addPolyline(const Point *pts, int count, bool closed, const Scalar &color, int thickness)
+{
+    polylines.push_back({(int)points.size(), count, closed, color, thickness});
+    points.insert(points.end(), pts, pts + count);
+    int minX = pts[0].x, minY = pts[0].y, maxX = minX, maxY = minY;
+    for (int i = 1; i < count; ++i)
+    {
+        minX = min(minX, pts[i].x);
+        minY = min(minY, pts[i].y);
+        maxX = max(maxX, pts[i].x);
+        maxY = max(maxY, pts[i].y);
+    }
+    Rect rect(minX, minY, maxX - minX + 1, maxY - minY + 1);
+    bounds = rectUnion(bounds, padRect(rect, thickness / 2 + 2));
+}
+
+}
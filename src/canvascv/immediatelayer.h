@@ -0,0 +1,141 @@
+#ifndef IMMEDIATELAYER_H
+#define IMMEDIATELAYER_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <string>
+#include <vector>
+
+namespace canvascv
+{
+
+/**
+ * @brief The ImmediateLayer class
+ *
+ * Non interactive drawing primitives (boxes, polylines, circles, labels and markers) for
+ * what is replaced every frame, like the detections of a video. Unlike shapes, they have
+ * no handles, callbacks, themes or ids: they are plain records in arrays which keep their
+ * memory between frames, so filling the layer doesn't allocate once it warmed up.
+ *
+ * Get it with Canvas::getImmediateLayer(), fill it before each redraw and the Canvas
+ * draws it over the shapes and under the widgets, and then clears it.
+ *
+ * Outlines (boxes and polylines) of the same color and thickness are rasterized by a single
+ * call, so they are drawn by style rather than by the order they were added in.
+ */
+class ImmediateLayer
+{
+public:
+    ImmediateLayer();
+
+    /// a rectangle outline, or a filled rectangle if thickness is negative
+    void box(const cv::Rect &rect, const cv::Scalar &color, int thickness = 2);
+
+    /// a polyline of 'count' points (copied)
+    void polyline(const cv::Point *points, int count, bool closed, const cv::Scalar &color,
+                  int thickness = 2);
+
+    /// a polyline of all the points of a vector
+    void polyline(const std::vector<cv::Point> &points, bool closed, const cv::Scalar &color,
+                  int thickness = 2);
+
+    void circle(const cv::Point &center, int radius, const cv::Scalar &color, int thickness = 2);
+
+    /**
+     * @brief label
+     *
+     * text on a filled rectangle
+     * @param topLeft is the top left corner of the rectangle
+     */
+    void label(const std::string &text, const cv::Point &topLeft, const cv::Scalar &color,
+               const cv::Scalar &bgColor, double fontScale = 0.5, int thickness = 1);
+
+    /// a marker of cv::MarkerTypes
+    void marker(const cv::Point &pos, const cv::Scalar &color, int markerType = cv::MARKER_CROSS,
+                int size = 20, int thickness = 2);
+
+    int getLineType() const;
+
+    /// the line type of all the primitives (cv::LINE_8 by default)
+    void setLineType(int value);
+
+    /// drop all the primitives (keeping the memory for the next frame)
+    void clear();
+
+    bool empty() const;
+
+    /// the bounding rect of all the primitives
+    const cv::Rect &getBounds() const;
+
+    /// draw the filled boxes, the outlines, the circles, the markers and then the labels
+    void renderOn(cv::Mat &dst) const;
+
+private:
+    struct Polyline
+    {
+        int first;      ///< into points
+        int count;
+        bool closed;
+        cv::Scalar color;
+        int thickness;
+    };
+
+    struct Fill
+    {
+        cv::Rect rect;
+        cv::Scalar color;
+    };
+
+    struct Circle
+    {
+        cv::Point center;
+        int radius;
+        cv::Scalar color;
+        int thickness;
+    };
+
+    struct Marker
+    {
+        cv::Point pos;
+        cv::Scalar color;
+        int type;
+        int size;
+        int thickness;
+    };
+
+    struct Label
+    {
+        int first;      ///< into chars
+        int length;
+        cv::Rect rect;
+        cv::Point org;
+        cv::Scalar color;
+        cv::Scalar bgColor;
+        double fontScale;
+        int thickness;
+    };
+
+    void addPolyline(const cv::Point *pts, int count, bool closed, const cv::Scalar &color,
+                     int thickness);
+
+    int lineType;
+    cv::Rect bounds;
+    std::vector<cv::Point> points;
+    std::vector<Polyline> polylines;
+    std::vector<Fill> fills;
+    std::vector<Circle> circles;
+    std::vector<Marker> markers;
+    std::vector<Label> labels;
+    std::string chars;
+
+    // scratch of renderOn(), kept to reuse its memory
+    mutable std::vector<int> order;
+    mutable std::vector<cv::Point> batchPoints;
+    mutable std::vector<int> batchCounts;
+    mutable std::string text;
+};
+
+}
+
+#endif // IMMEDIATELAYER_H
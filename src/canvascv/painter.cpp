@@ -0,0 +1,205 @@
+#include "painter.h"
+#include "drawlist.h"
+#include "blend.h"
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+// the DrawList of the active Recorder of this thread
+static thread_local DrawList *recording = nullptr;
+
+static DrawList::Op newOp(DrawList::Op::Kind kind, const Scalar &color, int thickness, int lineType, int shift = 0)
+{
+    DrawList::Op op;
+    op.kind = kind;
+    op.color = color;
+    op.param = 0;
+    op.radius = 0;
+    op.thickness = thickness;
+    op.lineType = lineType;
+    op.shift = shift;
+    op.index = -1;
+    return op;
+}
+
+static void blendImage(Mat &dst, const Mat &img, const Point &pos, bool premultiplied)
+{
+    Rect rect(pos, img.size());
+    Rect intersection = rect & Rect(Point(0, 0), dst.size());
+    if (intersection.area() == 0) return;
+
+    Mat roiDst(dst, intersection);
+    Mat roiSrc(img, Rect(intersection.x - rect.x,
+                         intersection.y - rect.y,
+                         intersection.width, intersection.height));
+    if (premultiplied)
+    {
+        Blend::premultipliedOver(roiSrc, roiDst);
+    }
+    else if (roiSrc.channels() == 4)
+    {
+        Blend::over(roiSrc, roiDst);
+    }
+    else if (roiDst.channels() == 4)
+    {
+        Blend::copyOpaque(roiSrc, roiDst);
+    }
+    else
+    {
+        roiSrc.copyTo(roiDst);
+    }
+}
+
+Painter::Recorder::Recorder(DrawList &list)
+    : prev(recording)
+{
+    recording = &list;
+}
+
+Painter::Recorder::~Recorder()
+{
+    recording = prev;
+}
+
+bool Painter::isRecording()
+{
+    return recording != nullptr;
+}
+
+void Painter::line(Mat &dst, Point pt1, Point pt2, const Scalar &color, int thickness, int lineType, int shift)
+{
+    if (! recording)
+    {
+        cv::line(dst, pt1, pt2, color, thickness, lineType, shift);
+        return;
+    }
+    DrawList::Op op = newOp(DrawList::Op::LINE, color, thickness, lineType, shift);
+    op.pt1 = pt1;
+    op.pt2 = pt2;
+    recording->add(op);
+}
+
+void Painter::arrowedLine(Mat &dst, Point pt1, Point pt2, const Scalar &color,
+                          int thickness, int lineType, int shift, double tipLength)
+{
+    if (! recording)
+    {
+        cv::arrowedLine(dst, pt1, pt2, color, thickness, lineType, shift, tipLength);
+        return;
+    }
+    DrawList::Op op = newOp(DrawList::Op::ARROWED_LINE, color, thickness, lineType, shift);
+    op.pt1 = pt1;
+    op.pt2 = pt2;
+    op.param = tipLength;
+    recording->add(op);
+}
+
+void Painter::circle(Mat &dst, Point center, int radius, const Scalar &color, int thickness, int lineType, int shift)
+{
+    if (! recording)
+    {
+        cv::circle(dst, center, radius, color, thickness, lineType, shift);
+        return;
+    }
+    DrawList::Op op = newOp(DrawList::Op::CIRCLE, color, thickness, lineType, shift);
+    op.pt1 = center;
+    op.radius = radius;
+    recording->add(op);
+}
+
+void Painter::ellipse(Mat &dst, const RotatedRect &box, const Scalar &color, int thickness, int lineType)
+{
+    if (! recording)
+    {
+        cv::ellipse(dst, box, color, thickness, lineType);
+        return;
+    }
+    DrawList::Op op = newOp(DrawList::Op::ELLIPSE, color, thickness, lineType);
+    op.box = box;
+    recording->add(op);
+}
+
+void Painter::rectangle(Mat &dst, Rect rect, const Scalar &color, int thickness, int lineType, int shift)
+{
+    if (! recording)
+    {
+        cv::rectangle(dst, rect, color, thickness, lineType, shift);
+        return;
+    }
+    DrawList::Op op = newOp(DrawList::Op::RECTANGLE, color, thickness, lineType, shift);
+    op.pt1 = rect.tl();
+    op.pt2 = rect.br();
+    recording->add(op);
+}
+
+void Painter::polylines(Mat &dst, const Point *points, const int *counts, int contours,
+                        bool closed, const Scalar &color, int thickness, int lineType, int shift)
+{
+    if (contours <= 0) return;
+    if (! recording)
+    {
+        static thread_local vector<const Point*> starts;
+        starts.clear();
+        for (int i = 0; i < contours; points += counts[i++])
+        {
+            starts.push_back(points);
+        }
+        cv::polylines(dst, starts.data(), counts, contours, closed, color, thickness, lineType, shift);
+        return;
+    }
+    DrawList::Op op = newOp(DrawList::Op::POLYLINES, color, thickness, lineType, shift);
+    op.param = closed ? 1 : 0;
+    op.index = recording->addPolylines(points, counts, contours);
+    recording->add(op);
+}
+
+void Painter::marker(Mat &dst, Point pos, const Scalar &color, int markerType, int markerSize,
+                     int thickness, int lineType)
+{
+    if (! recording)
+    {
+        cv::drawMarker(dst, pos, color, markerType, markerSize, thickness, lineType);
+        return;
+    }
+    DrawList::Op op = newOp(DrawList::Op::MARKER, color, thickness, lineType);
+    op.pt1 = pos;
+    op.radius = markerSize;
+    op.index = markerType;
+    recording->add(op);
+}
+
+void Painter::putText(Mat &dst, const string &text, Point org, int fontFace, double fontScale,
+                      Scalar color, int thickness, int lineType)
+{
+    if (! recording)
+    {
+        cv::putText(dst, text, org, fontFace, fontScale, color, thickness, lineType);
+        return;
+    }
+    DrawList::Op op = newOp(DrawList::Op::TEXT, color, thickness, lineType);
+    op.pt1 = org;
+    op.radius = fontFace;
+    op.param = fontScale;
+    op.index = recording->addText(text);
+    recording->add(op);
+}
+
+void Painter::image(Mat &dst, const Mat &img, Point pos, bool premultiplied, bool immutable)
+{
+    if (img.empty()) return;
+    if (! recording)
+    {
+        blendImage(dst, img, pos, premultiplied);
+        return;
+    }
+    DrawList::Op op = newOp(premultiplied ? DrawList::Op::PREMULTIPLIED_IMAGE : DrawList::Op::IMAGE,
+                            Scalar(), 0, 0);
+    op.pt1 = pos;
+    op.index = recording->addImage(immutable ? img : img.clone());
+    recording->add(op);
+}
+
+}
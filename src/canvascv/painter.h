@@ -0,0 +1,95 @@
+#ifndef PAINTER_H
+#define PAINTER_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <string>
+
+namespace canvascv
+{
+
+class DrawList;
+
+/**
+ * @brief The Painter class
+ *
+ * The drawing primitives used by shapes and widgets to draw on the canvas. They take the
+ * same arguments as their OpenCV equivalents and draw directly on the given Mat, unless a
+ * Recorder is active on the calling thread. Then they only append to its DrawList, which
+ * can be replayed later (e.g. by the render thread of the Canvas).
+ *
+ * @note
+ * Custom shapes should draw through the Painter too, or they will not be shown when the
+ * Canvas renders on a separate thread (see Canvas::setRenderThread()).
+ */
+class Painter
+{
+public:
+    /// While alive, the Painter calls on this thread are recorded into 'list' instead of drawn
+    class Recorder
+    {
+    public:
+        Recorder(DrawList &list);
+        ~Recorder();
+    private:
+        DrawList *prev;
+    };
+
+    /// true if a Recorder is active on the calling thread
+    static bool isRecording();
+
+    static void line(cv::Mat &dst, cv::Point pt1, cv::Point pt2, const cv::Scalar &color,
+                     int thickness = 1, int lineType = cv::LINE_8, int shift = 0);
+
+    static void arrowedLine(cv::Mat &dst, cv::Point pt1, cv::Point pt2, const cv::Scalar &color,
+                            int thickness = 1, int lineType = cv::LINE_8, int shift = 0,
+                            double tipLength = 0.1);
+
+    static void circle(cv::Mat &dst, cv::Point center, int radius, const cv::Scalar &color,
+                       int thickness = 1, int lineType = cv::LINE_8, int shift = 0);
+
+    static void ellipse(cv::Mat &dst, const cv::RotatedRect &box, const cv::Scalar &color,
+                        int thickness = 1, int lineType = cv::LINE_8);
+
+    static void rectangle(cv::Mat &dst, cv::Rect rect, const cv::Scalar &color,
+                          int thickness = 1, int lineType = cv::LINE_8, int shift = 0);
+
+    /**
+     * @brief polylines
+     *
+     * draw several polylines of the same style with a single rasterization call
+     * @param points are the points of all the polylines, one polyline after the other
+     * @param counts are the amounts of points of each polyline
+     * @param contours is the amount of polylines
+     */
+    static void polylines(cv::Mat &dst, const cv::Point *points, const int *counts, int contours,
+                          bool closed, const cv::Scalar &color,
+                          int thickness = 1, int lineType = cv::LINE_8, int shift = 0);
+
+    static void marker(cv::Mat &dst, cv::Point pos, const cv::Scalar &color,
+                       int markerType = cv::MARKER_CROSS, int markerSize = 20,
+                       int thickness = 1, int lineType = cv::LINE_8);
+
+    static void putText(cv::Mat &dst, const std::string &text, cv::Point org,
+                        int fontFace, double fontScale, cv::Scalar color,
+                        int thickness = 1, int lineType = cv::LINE_8);
+
+    /**
+     * @brief image
+     *
+     * blend an image onto dst, clipped to dst
+     * @param dst is a CV_8UC3 or CV_8UC4 Mat
+     * @param img is a CV_8UC3 Mat (copied as is), or a CV_8UC4 Mat (blended by its alpha)
+     * @param pos is the top left of img on dst
+     * @param premultiplied means img is a CV_8UC4 premultiplied Mat (see Blend)
+     * @param immutable means img is never written to again, so recording can keep a
+     * reference to it instead of a copy
+     */
+    static void image(cv::Mat &dst, const cv::Mat &img, cv::Point pos,
+                      bool premultiplied = false, bool immutable = false);
+};
+
+}
+
+#endif // PAINTER_H
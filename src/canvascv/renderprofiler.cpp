@@ -0,0 +1,173 @@
+#include "renderprofiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+RenderProfiler::Histogram::Histogram(int window)
+    : samples(max(window, 1)),
+      next(0),
+      count(0),
+      bins(BINS, 0),
+      sum(0)
+{
+}
+
+void RenderProfiler::Histogram::add(double ms)
+{
+    if (count == (int)samples.size())
+    {   // the oldest sample leaves the window
+        --bins[binOf(samples[next])];
+        sum -= samples[next];
+    }
+    else
+    {
+        ++count;
+    }
+    samples[next] = ms;
+    ++bins[binOf(ms)];
+    sum += ms;
+    next = (next + 1) % samples.size();
+}
+
+int RenderProfiler::Histogram::getCount() const
+{
+    return count;
+}
+
+const vector<int> &RenderProfiler::Histogram::getBins() const
+{
+    return bins;
+}
+
+double RenderProfiler::Histogram::getMean() const
+{
+    return count ? sum / count : 0;
+}
+
+double RenderProfiler::Histogram::getMax() const
+{
+    double result = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        result = max(result, samples[i]);
+    }
+    return result;
+}
+
+double RenderProfiler::Histogram::getPercentile(double fraction) const
+{
+    int needed = (int)ceil(fraction * count);
+    int seen = 0;
+    for (int i = 0; i < BINS; ++i)
+    {
+        seen += bins[i];
+        if (seen >= needed && seen > 0)
+        {
+            return ldexp(1, i) / 1000; // the upper edge of bin i in milliseconds
+        }
+    }
+    return 0;
+}
+
+int RenderProfiler::Histogram::binOf(double ms)
+{
+    double us = ms * 1000;
+    int bin = 0;
+    while (us >= 1 && bin < BINS - 1)
+    {
+        us /= 2;
+        ++bin;
+    }
+    return bin;
+}
+
+RenderProfiler::RenderProfiler(int windowVal)
+    : window(windowVal),
+      frames(0),
+      histograms(PHASE_COUNT, Histogram(windowVal))
+{
+    fill(phaseTicks, phaseTicks + PHASE_COUNT, 0);
+}
+
+const char *RenderProfiler::getPhaseName(Phase phase)
+{
+    static const char *names[PHASE_COUNT] =
+    {
+        "input", "update widgets", "shapes", "immediate layer", "widgets", "texts", "total"
+    };
+    return names[phase];
+}
+
+const RenderProfiler::Histogram &RenderProfiler::getHistogram(Phase phase) const
+{
+    return histograms[phase];
+}
+
+const map<string, RenderProfiler::Histogram> &RenderProfiler::getShapeHistograms() const
+{
+    return shapeHistograms;
+}
+
+uint64_t RenderProfiler::getFrameCount() const
+{
+    return frames;
+}
+
+void RenderProfiler::reset()
+{
+    frames = 0;
+    histograms.assign(PHASE_COUNT, Histogram(window));
+    shapeHistograms.clear();
+}
+
+void RenderProfiler::addShape(const char *type, int64_t ticks)
+{
+    // types are static strings, so their pointers identify them
+    for (auto &entry : shapeTicks)
+    {
+        if (entry.first == type)
+        {
+            entry.second += ticks;
+            return;
+        }
+    }
+    shapeTicks.push_back(make_pair(type, ticks));
+}
+
+void RenderProfiler::beginFrame()
+{
+    fill(phaseTicks, phaseTicks + PHASE_COUNT, 0);
+    shapeTicks.clear();
+}
+
+void RenderProfiler::add(Phase phase, int64_t ticks)
+{
+    phaseTicks[phase] += ticks;
+}
+
+void RenderProfiler::endFrame()
+{
+    const double msPerTick = 1000 / getTickFrequency();
+    for (int phase = 0; phase < PHASE_COUNT; ++phase)
+    {
+        histograms[phase].add(phaseTicks[phase] * msPerTick);
+    }
+    for (auto &entry : shapeTicks)
+    {
+        auto iter = shapeHistograms.find(entry.first);
+        if (iter == shapeHistograms.end())
+        {
+            iter = shapeHistograms.insert(make_pair(string(entry.first), Histogram(window))).first;
+        }
+        iter->second.add(entry.second * msPerTick);
+    }
+    ++frames;
+}
+
+}
@@ -0,0 +1,162 @@
+#ifndef RENDERPROFILER_H
+#define RENDERPROFILER_H
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace canvascv
+{
+
+/**
+ * @brief The RenderProfiler class
+ *
+ * Per frame timings of the phases of Canvas::redrawOn(), kept as rolling histograms of the
+ * last frames. Enable it with Canvas::setProfiling() and read it with Canvas::getProfiler().
+ * When profiling is disabled there is no profiler, and the Canvas skips all the timing.
+ *
+ * The draw time of each shape type is measured too, unless the shapes are drawn by the
+ * parallel redraw (see Canvas::setParallelRedraw()).
+ */
+class RenderProfiler
+{
+public:
+    /// the measured phases of a frame
+    enum Phase
+    {
+        INPUT,           ///< copying the input frame and converting its colors
+        UPDATE_WIDGETS,  ///< updating the dirty widgets
+        SHAPES,          ///< drawing (or blending) the shapes
+        IMMEDIATE_LAYER, ///< drawing the immediate layer
+        WIDGETS,         ///< rendering the widgets
+        TEXTS,           ///< rendering the screen text and the status message
+        TOTAL,           ///< the whole frame
+        PHASE_COUNT
+    };
+
+    /// durations of the last 'window' frames
+    class Histogram
+    {
+    public:
+        /// bin 0 counts durations under 1 microsecond, and bin i (i > 0) durations of [2^(i-1), 2^i) microseconds
+        static const int BINS = 24;
+
+        Histogram(int window);
+
+        /// add the duration of a frame in milliseconds (the oldest one is dropped once the window is full)
+        void add(double ms);
+
+        /// the amount of frames in the window
+        int getCount() const;
+
+        /// the counts of the bins, of the frames in the window
+        const std::vector<int> &getBins() const;
+
+        /// in milliseconds
+        double getMean() const;
+
+        /// in milliseconds
+        double getMax() const;
+
+        /// the upper edge (in milliseconds) of the bin in which 'fraction' (0 to 1) of the frames are
+        double getPercentile(double fraction) const;
+
+    private:
+        static int binOf(double ms);
+
+        std::vector<double> samples;
+        int next;
+        int count;
+        std::vector<int> bins;
+        double sum;
+    };
+
+    /// times a phase of the current frame, and does nothing without a profiler
+    class Scope
+    {
+    public:
+        Scope(RenderProfiler *profilerVal, Phase phaseVal)
+            : profiler(profilerVal), phase(phaseVal), start(profiler ? cv::getTickCount() : 0) {}
+
+        ~Scope()
+        {
+            if (profiler) profiler->add(phase, cv::getTickCount() - start);
+        }
+
+    private:
+        RenderProfiler *profiler;
+        Phase phase;
+        int64_t start;
+    };
+
+    /// a frame: all the phases timed while it is alive are summed into it
+    class Frame
+    {
+    public:
+        Frame(RenderProfiler *profilerVal)
+            : profiler(profilerVal), start(0)
+        {
+            if (profiler)
+            {
+                profiler->beginFrame();
+                start = cv::getTickCount();
+            }
+        }
+
+        ~Frame()
+        {
+            if (profiler)
+            {
+                profiler->add(TOTAL, cv::getTickCount() - start);
+                profiler->endFrame();
+            }
+        }
+
+    private:
+        RenderProfiler *profiler;
+        int64_t start;
+    };
+
+    /// @param window is the amount of frames kept by the histograms
+    RenderProfiler(int window = 120);
+
+    static const char *getPhaseName(Phase phase);
+
+    const Histogram &getHistogram(Phase phase) const;
+
+    /// the shapes draw time by shape type (see Shape::getType())
+    const std::map<std::string, Histogram> &getShapeHistograms() const;
+
+    /// the amount of frames profiled since it was created
+    uint64_t getFrameCount() const;
+
+    /// forget all the frames
+    void reset();
+
+private:
+    friend class Canvas;
+
+    /// add the draw duration of a shape of 'type' to the current frame
+    void addShape(const char *type, int64_t ticks);
+
+    void beginFrame();
+    void add(Phase phase, int64_t ticks);
+    void endFrame();
+
+    int window;
+    uint64_t frames;
+    std::vector<Histogram> histograms;
+    std::map<std::string, Histogram> shapeHistograms;
+
+    // the current frame, in ticks
+    int64_t phaseTicks[PHASE_COUNT];
+    std::vector<std::pair<const char*, int64_t>> shapeTicks;
+};
+
+}
+
+#endif // RENDERPROFILER_H
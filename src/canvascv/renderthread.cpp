@@ -0,0 +1,87 @@
+#include "renderthread.h"
+#include "drawlist.h"
+
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+RenderThread::RenderThread()
+    : quit(false),
+      hasJob(false),
+      hasReady(false),
+      thread(&RenderThread::run, this)
+{
+}
+
+RenderThread::~RenderThread()
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        quit = true;
+    }
+    wakeUp.notify_one();
+    thread.join();
+}
+
+void RenderThread::submit(const Mat &src, const shared_ptr<DrawList> &list)
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        jobSrc = src;
+        jobList = list;
+        hasJob = true;
+    }
+    wakeUp.notify_one();
+}
+
+bool RenderThread::fetch(Mat &dst)
+{
+    lock_guard<mutex> lock(mtx);
+    if (! hasReady) return false;
+    swap(ready, presenting);
+    hasReady = false;
+    dst = presenting;
+    return true;
+}
+
+void RenderThread::run()
+{
+    while (true)
+    {
+        Mat src;
+        shared_ptr<DrawList> list;
+        {
+            unique_lock<mutex> lock(mtx);
+            wakeUp.wait(lock, [this]() { return quit || hasJob; });
+            if (quit) return;
+            src = jobSrc;
+            list = jobList;
+            jobSrc.release();
+            jobList.reset();
+            hasJob = false;
+        }
+
+        if (src.channels() == 1)
+        {
+            cvtColor(src, rendering, CV_GRAY2BGR);
+        }
+        else
+        {
+            src.copyTo(rendering);
+        }
+        if (list)
+        {
+            list->replayOn(rendering);
+        }
+
+        lock_guard<mutex> lock(mtx);
+        swap(rendering, ready);
+        hasReady = true;
+    }
+}
+
+}
@@ -0,0 +1,70 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <opencv2/core.hpp>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace canvascv
+{
+
+class DrawList;
+
+/**
+ * @brief The RenderThread class
+ *
+ * Renders frames on a separate thread. A frame is a source image with a DrawList
+ * recorded on top of it. Rendering is triple buffered: the thread renders into one
+ * buffer while the latest completed frame waits in another, and the caller presents
+ * the third. Frames submitted while the thread is busy replace each other, so the
+ * newest one is rendered next and the caller is never blocked by a slow frame.
+ */
+class RenderThread
+{
+public:
+    RenderThread();
+
+    /// waits for the frame being rendered (if any) and stops the thread
+    ~RenderThread();
+
+    /**
+     * @brief submit a frame to render
+     *
+     * @param src is the frame. It is kept by reference, so it must not be written to later.
+     * @param list is drawn on top of src (may be null)
+     */
+    void submit(const cv::Mat &src, const std::shared_ptr<DrawList> &list);
+
+    /**
+     * @brief fetch the latest rendered frame
+     *
+     * @param dst will reference the frame, which stays valid until the next fetch()
+     * @return false if nothing new was rendered since the last fetch()
+     */
+    bool fetch(cv::Mat &dst);
+
+private:
+    void run();
+
+    std::mutex mtx;
+    std::condition_variable wakeUp;
+    bool quit;
+
+    bool hasJob;
+    cv::Mat jobSrc;
+    std::shared_ptr<DrawList> jobList;
+
+    cv::Mat rendering;
+    cv::Mat ready;
+    cv::Mat presenting;
+    bool hasReady;
+
+    std::thread thread; // last, so it starts after the rest is initialized
+};
+
+}
+
+#endif // RENDERTHREAD_H
@@ -0,0 +1,178 @@
+#include "shapeindex.h"
+#include "shapes/shape.h"
+
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+// shapes accept clicks a few pixels outside of what they draw (see Handle::isPoint())
+static const int HIT_MARGIN = 4;
+
+// shapes spanning more cells than this are candidates of every query
+static const int64_t MAX_CELLS = 256;
+
+static inline int64_t floorDiv(int64_t value, int64_t divisor)
+{
+    return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+static inline int64_t cellKey(int64_t cx, int64_t cy)
+{
+    return (int64_t)(((uint64_t)cx << 32) ^ (uint32_t)cy);
+}
+
+static inline bool boundsContain(const Rect &bounds, const Point &pos)
+{
+    return pos.x >= bounds.x && pos.y >= bounds.y &&
+            pos.x < (int64_t)bounds.x + bounds.width &&
+            pos.y < (int64_t)bounds.y + bounds.height;
+}
+
+ShapeIndex::ShapeIndex(int cellSizeVal)
+    : cellSize(cellSizeVal),
+      nextOrder(0)
+{
+}
+
+void ShapeIndex::insert(const shared_ptr<Shape> &shape)
+{
+    Entry &entry = entries[shape.get()];
+    entry.shape = shape;
+    entry.order = nextOrder++;
+    entry.stale = true;
+    stale.push_back(shape.get());
+}
+
+void ShapeIndex::remove(Shape *shape)
+{
+    auto iter = entries.find(shape);
+    if (iter == entries.end()) return;
+    Entry &entry = iter->second;
+    if (entry.stale)
+    {
+        stale.erase(find(stale.begin(), stale.end(), shape));
+    }
+    else
+    {
+        unplace(shape, entry);
+    }
+    entries.erase(iter);
+}
+
+void ShapeIndex::invalidate(Shape *shape)
+{
+    auto iter = entries.find(shape);
+    if (iter == entries.end() || iter->second.stale) return;
+    unplace(shape, iter->second);
+    iter->second.stale = true;
+    stale.push_back(shape);
+}
+
+void ShapeIndex::clear()
+{
+    entries.clear();
+    grid.clear();
+    large.clear();
+    stale.clear();
+}
+
+void ShapeIndex::query(const Point &pos, vector<shared_ptr<Shape>> &result)
+{
+    result.clear();
+    refresh();
+
+    vector<const Entry*> found;
+    auto cell = grid.find(cellKey(floorDiv(pos.x, cellSize), floorDiv(pos.y, cellSize)));
+    if (cell != grid.end())
+    {
+        for (Shape *shape : cell->second)
+        {
+            const Entry &entry = entries[shape];
+            if (boundsContain(entry.bounds, pos)) found.push_back(&entry);
+        }
+    }
+    for (Shape *shape : large)
+    {
+        const Entry &entry = entries[shape];
+        if (boundsContain(entry.bounds, pos)) found.push_back(&entry);
+    }
+
+    sort(found.begin(), found.end(), [](const Entry *a, const Entry *b) { return a->order < b->order; });
+    for (const Entry *entry : found)
+    {
+        result.push_back(entry->shape);
+    }
+}
+
+void ShapeIndex::refresh()
+{
+    for (Shape *shape : stale)
+    {
+        Entry &entry = entries[shape];
+        entry.stale = false;
+        place(entry);
+    }
+    stale.clear();
+}
+
+void ShapeIndex::place(Entry &entry)
+{
+    Rect bounds = entry.shape->getBounds();
+    int64_t x0 = (int64_t)bounds.x - HIT_MARGIN;
+    int64_t y0 = (int64_t)bounds.y - HIT_MARGIN;
+    int64_t x1 = (int64_t)bounds.x + bounds.width + HIT_MARGIN;  // exclusive
+    int64_t y1 = (int64_t)bounds.y + bounds.height + HIT_MARGIN; // exclusive
+    x0 = max<int64_t>(x0, INT_MIN);
+    y0 = max<int64_t>(y0, INT_MIN);
+    entry.bounds = Rect((int)x0, (int)y0,
+                        (int)min<int64_t>(x1 - x0, INT_MAX),
+                        (int)min<int64_t>(y1 - y0, INT_MAX));
+
+    int64_t cx0 = floorDiv(x0, cellSize), cx1 = floorDiv(x1 - 1, cellSize);
+    int64_t cy0 = floorDiv(y0, cellSize), cy1 = floorDiv(y1 - 1, cellSize);
+    if (bounds.width <= 0 || bounds.height <= 0 ||
+            (cx1 - cx0 + 1) * (cy1 - cy0 + 1) > MAX_CELLS)
+    {
+        entry.cells = Rect();
+        large.push_back(entry.shape.get());
+        return;
+    }
+
+    entry.cells = Rect((int)cx0, (int)cy0, (int)(cx1 - cx0 + 1), (int)(cy1 - cy0 + 1));
+    for (int64_t cy = cy0; cy <= cy1; ++cy)
+    {
+        for (int64_t cx = cx0; cx <= cx1; ++cx)
+        {
+            grid[cellKey(cx, cy)].push_back(entry.shape.get());
+        }
+    }
+}
+
+void ShapeIndex::unplace(Shape *shape, Entry &entry)
+{
+    if (entry.cells.area() == 0)
+    {
+        large.erase(find(large.begin(), large.end(), shape));
+        return;
+    }
+    for (int cy = entry.cells.y; cy < entry.cells.y + entry.cells.height; ++cy)
+    {
+        for (int cx = entry.cells.x; cx < entry.cells.x + entry.cells.width; ++cx)
+        {
+            auto cell = grid.find(cellKey(cx, cy));
+            vector<Shape*> &cellShapes = cell->second;
+            cellShapes.erase(find(cellShapes.begin(), cellShapes.end(), shape));
+            if (cellShapes.empty())
+            {
+                grid.erase(cell);
+            }
+        }
+    }
+}
+
+}
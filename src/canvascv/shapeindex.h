@@ -0,0 +1,76 @@
+#ifndef SHAPEINDEX_H
+#define SHAPEINDEX_H
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace canvascv
+{
+
+class Shape;
+
+/**
+ * @brief The ShapeIndex class
+ *
+ * A uniform grid of the shapes bounding rects, so point queries only visit the shapes
+ * near the point. Shapes which changed are marked as stale and re-bucketed lazily on the
+ * next query, so a drag doesn't pay for updates of every mouse move.
+ *
+ * Shapes with very large bounds (e.g. custom shapes which don't override
+ * Shape::getBoundingRect()) are kept aside and are candidates of every query.
+ */
+class ShapeIndex
+{
+public:
+    /// @param cellSize is the width and height of the grid cells in pixels
+    ShapeIndex(int cellSize = 64);
+
+    /// add a shape, which comes after all the shapes already in the index
+    void insert(const std::shared_ptr<Shape> &shape);
+
+    /// forget a shape
+    void remove(Shape *shape);
+
+    /// the bounds of shape changed (ignored for shapes not in the index)
+    void invalidate(Shape *shape);
+
+    void clear();
+
+    /**
+     * @brief query
+     *
+     * get the shapes whose bounds may contain pos, by their insertion order
+     * @param pos is in canvas coordinates
+     * @param result is cleared and filled with the candidates
+     */
+    void query(const cv::Point &pos, std::vector<std::shared_ptr<Shape>> &result);
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<Shape> shape;
+        uint64_t order;
+        cv::Rect bounds;
+        cv::Rect cells; ///< the cells range (empty for the large ones)
+        bool stale;
+    };
+
+    void refresh();
+    void place(Entry &entry);
+    void unplace(Shape *shape, Entry &entry);
+
+    int cellSize;
+    uint64_t nextOrder;
+    std::unordered_map<Shape*, Entry> entries;
+    std::unordered_map<int64_t, std::vector<Shape*>> grid;
+    std::vector<Shape*> large;
+    std::vector<Shape*> stale;
+};
+
+}
+
+#endif // SHAPEINDEX_H
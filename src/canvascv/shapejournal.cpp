@@ -0,0 +1,295 @@
+#include "shapejournal.h"
+#include "shapes/binaryarchive.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+// the journal starts with a tag and the layout version, followed by records of
+// a little endian payload size and checksum, and a payload written by a BinaryWriter
+static const char LAYOUT_TAG[4] = {'C', 'C', 'V', 'J'};
+static const size_t HEADER_SIZE = 8;
+static const size_t RECORD_HEADER_SIZE = 8;
+
+static void setU32(uint8_t *p, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        p[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static uint32_t getU32(const uint8_t *p)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        value |= (uint32_t)p[i] << (i * 8);
+    }
+    return value;
+}
+
+// FNV-1a, enough to tell a torn record from a whole one
+static uint32_t checksum(const uint8_t *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// false if there is no such file
+static bool readFile(const string &filepath, vector<uint8_t> &data)
+{
+    ifstream file(filepath, ios::binary);
+    if (! file) return false;
+    data.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    return true;
+}
+
+ShapeJournal::ShapeJournal(Canvas &canvasVal, const string &filepath)
+    : canvas(canvasVal),
+      snapshotPath(filepath),
+      journalPath(filepath + ".journal"),
+      journalSize(0),
+      maxJournalSize(4 << 20),
+      loading(false)
+{
+    createCbId = canvas.notifyOnShapeCreate([this](Shape *shape)
+    {
+        record(CREATED, *shape);
+    });
+    modifyCbId = canvas.notifyOnShapeModify([this](Shape *shape)
+    {
+        record(MODIFIED, *shape);
+    });
+    deleteCbId = canvas.notifyOnShapeDelete([this](Shape *shape)
+    {
+        record(DELETED, *shape);
+    });
+}
+
+ShapeJournal::~ShapeJournal()
+{
+    canvas.rmvNotifyOnShapeCreate(createCbId);
+    canvas.rmvNotifyOnShapeModify(modifyCbId);
+    canvas.rmvNotifyOnShapeDelete(deleteCbId);
+}
+
+bool ShapeJournal::load()
+{
+    vector<uint8_t> data;
+    string name;
+    vector<Shape*> scene;
+    if (readFile(snapshotPath, data) && ! Canvas::readShapes(data.data(), data.size(), name, scene))
+    {
+        return false;
+    }
+
+    // the scene by drawing order, with an index by id for the records
+    unordered_map<int, size_t> positions;
+    for (size_t i = 0; i < scene.size(); ++i)
+    {
+        positions[scene[i]->getId()] = i;
+    }
+    auto discard = [&scene]()
+    {
+        for (Shape *shape : scene)
+        {
+            delete shape;
+        }
+    };
+
+    // records are idempotent (a create of an existing shape replaces it), so a journal
+    // which was already compacted into the snapshot replays to the same scene
+    bool torn = false;
+    if (readFile(journalPath, data) && ! data.empty())
+    {
+        if (data.size() < HEADER_SIZE || memcmp(data.data(), LAYOUT_TAG, 4) != 0 ||
+                getU32(&data[4]) != LAYOUT_VERSION)
+        {
+            discard();
+            return false;
+        }
+        size_t pos = HEADER_SIZE;
+        while (pos < data.size())
+        {
+            if (data.size() - pos < RECORD_HEADER_SIZE)
+            {
+                torn = true;
+                break;
+            }
+            uint32_t size = getU32(&data[pos]);
+            uint32_t sum = getU32(&data[pos + 4]);
+            const uint8_t *payload = &data[pos + RECORD_HEADER_SIZE];
+            if (data.size() - pos - RECORD_HEADER_SIZE < size || checksum(payload, size) != sum)
+            {
+                torn = true;
+                break;
+            }
+            pos += RECORD_HEADER_SIZE + size;
+
+            BinaryReader in(payload, size);
+            uint8_t kind = in.u8();
+            if (kind == DELETED)
+            {
+                int id = in.id();
+                auto iter = positions.find(id);
+                if (in.ok() && iter != positions.end())
+                {
+                    delete scene[iter->second];
+                    scene[iter->second] = nullptr;
+                    positions.erase(iter);
+                }
+            }
+            else if (kind == CREATED || kind == MODIFIED)
+            {
+                Shape *shape = in.shape();
+                if (shape)
+                {
+                    auto iter = positions.find(shape->getId());
+                    if (iter != positions.end())
+                    {
+                        delete scene[iter->second];
+                        scene[iter->second] = shape;
+                    }
+                    else
+                    {
+                        positions[shape->getId()] = scene.size();
+                        scene.push_back(shape);
+                    }
+                }
+            }
+            else
+            {
+                in.fail();
+            }
+            if (! in.ok())
+            {   // a whole record which can't be read isn't a crash
+                discard();
+                return false;
+            }
+        }
+    }
+
+    loading = true;
+    canvas.clearShapes();
+    scene.erase(remove(scene.begin(), scene.end(), nullptr), scene.end());
+    canvas.placeReadShapes(scene);
+    loading = false;
+
+    if (torn)
+    {
+        compact();
+    }
+    else
+    {
+        openJournal(false);
+    }
+    return true;
+}
+
+bool ShapeJournal::compact()
+{
+    buffer.clear();
+    canvas.writeShapesToBuffer(buffer);
+    string tmpPath = snapshotPath + ".tmp";
+    {
+        ofstream file(tmpPath, ios::binary | ios::trunc);
+        file.write((const char*)buffer.data(), buffer.size());
+        if (! file.flush()) return false;
+    }
+    if (rename(tmpPath.c_str(), snapshotPath.c_str()) != 0)
+    {
+        // some platforms don't rename over an existing file
+        remove(snapshotPath.c_str());
+        if (rename(tmpPath.c_str(), snapshotPath.c_str()) != 0) return false;
+    }
+    openJournal(true);
+    return true;
+}
+
+void ShapeJournal::recordModify(Shape &shape)
+{
+    record(MODIFIED, shape);
+}
+
+size_t ShapeJournal::getJournalSize() const
+{
+    return journalSize;
+}
+
+size_t ShapeJournal::getMaxJournalSize() const
+{
+    return maxJournalSize;
+}
+
+void ShapeJournal::setMaxJournalSize(size_t value)
+{
+    maxJournalSize = value;
+}
+
+void ShapeJournal::record(RecordKind kind, Shape &shape)
+{
+    if (loading) return;
+    if (! journal.is_open()) openJournal(false);
+
+    // a deleted shape is still in the Canvas while it is notified, so only the other
+    // changes compact (and the snapshot already holds them)
+    if (kind != DELETED && journalSize > maxJournalSize && compact()) return;
+
+    BinaryWriter writer;
+    writer.u8(kind);
+    if (kind == DELETED)
+    {
+        writer.id(shape.getId());
+    }
+    else
+    {
+        writer.shape(shape);
+    }
+    buffer.assign(RECORD_HEADER_SIZE, 0);
+    writer.finish(buffer);
+    size_t size = buffer.size() - RECORD_HEADER_SIZE;
+    setU32(&buffer[0], (uint32_t)size);
+    setU32(&buffer[4], checksum(&buffer[RECORD_HEADER_SIZE], size));
+    journal.write((const char*)buffer.data(), buffer.size());
+    journal.flush();
+    journalSize += buffer.size();
+}
+
+void ShapeJournal::openJournal(bool truncate)
+{
+    journal.close();
+    journal.clear();
+    size_t size = 0;
+    if (! truncate)
+    {
+        ifstream existing(journalPath, ios::binary | ios::ate);
+        if (existing) size = (size_t)existing.tellg();
+        truncate = size < HEADER_SIZE; // not even a header to append to
+    }
+    journal.open(journalPath, ios::binary | (truncate ? ios::trunc : ios::app));
+    if (truncate)
+    {
+        uint8_t header[HEADER_SIZE];
+        memcpy(header, LAYOUT_TAG, 4);
+        setU32(header + 4, LAYOUT_VERSION);
+        journal.write((const char*)header, HEADER_SIZE);
+        journal.flush();
+        size = HEADER_SIZE;
+    }
+    journalSize = size;
+}
+
+}
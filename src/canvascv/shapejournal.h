@@ -0,0 +1,103 @@
+#ifndef SHAPEJOURNAL_H
+#define SHAPEJOURNAL_H
+
+#include "canvascv/canvas.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace canvascv
+{
+
+/**
+ * @brief The ShapeJournal class
+ *
+ * Incremental persistence of the shapes of a Canvas. Instead of rewriting all the shapes
+ * with Canvas::writeShapesToFile() after every edit, it appends a record per created,
+ * modified or deleted shape to a journal file as it happens, so a save costs the size
+ * of the change.
+ *
+ * - The shapes are kept in 2 files: a snapshot (in the binary format of
+ *   Canvas::writeShapesToBuffer()) at 'filepath', and the journal at filepath + ".journal".
+ * - load() reads the snapshot and replays the journal on it.
+ * - Once the journal grows past getMaxJournalSize() it is compacted: the snapshot is
+ *   rewritten from the Canvas shapes and the journal starts over.
+ * - Every record is flushed as it is written and checked when it is replayed, so a
+ *   crash loses at most the record which was being written.
+ *
+ * Records follow the Canvas notifications (see Canvas::notifyOnShapeModify()), so changes
+ * done by code rather than by the user should be recorded with recordModify().
+ * Destroy the journal before its Canvas, or the Canvas destructor deletes the shapes
+ * from the journal too.
+ */
+class ShapeJournal
+{
+public:
+    /// the version of the journal file layout
+    static const uint32_t LAYOUT_VERSION = 1;
+
+    ShapeJournal(Canvas &canvas, const std::string &filepath);
+
+    ~ShapeJournal();
+
+    /**
+     * @brief load the snapshot and the journal into the Canvas (removing all current shapes)
+     *
+     * Missing files are an empty scene. A torn record at the end of the journal (a crash
+     * while writing it) is dropped and the journal is compacted.
+     * @return false (and the Canvas is left as it was) if the snapshot or the journal isn't valid
+     */
+    bool load();
+
+    /**
+     * @brief write the current shapes to the snapshot and empty the journal
+     *
+     * @return false (and the journal is kept) if the snapshot couldn't be written
+     */
+    bool compact();
+
+    /// record a change to a shape which wasn't notified by the Canvas
+    void recordModify(Shape &shape);
+
+    /// the size in bytes of the journal since the last compaction
+    size_t getJournalSize() const;
+
+    size_t getMaxJournalSize() const;
+
+    /// the journal size (in bytes) which triggers a compaction (4MB by default)
+    void setMaxJournalSize(size_t value);
+
+private:
+    ShapeJournal(const ShapeJournal&) = delete;
+    ShapeJournal &operator=(const ShapeJournal&) = delete;
+
+    enum RecordKind
+    {
+        CREATED,
+        MODIFIED,
+        DELETED
+    };
+
+    void record(RecordKind kind, Shape &shape);
+
+    /// open the journal for appending, starting it over if 'truncate'
+    void openJournal(bool truncate);
+
+    Canvas &canvas;
+    std::string snapshotPath;
+    std::string journalPath;
+    Canvas::CBIDCanvasShape createCbId;
+    Canvas::CBIDCanvasShape modifyCbId;
+    Canvas::CBIDCanvasShape deleteCbId;
+    std::ofstream journal;
+    size_t journalSize;
+    size_t maxJournalSize;
+    bool loading;           // ignore the notifications of the shapes being loaded
+    std::vector<uint8_t> buffer;
+};
+
+}
+
+#endif // SHAPEJOURNAL_H
@@ -1,4 +1,5 @@
 #include "arrow.h"
+#include "canvascv/painter.h"
 #include "shapefactory.h"
 #include <opencv2/imgproc.hpp>
 
@@ -15,6 +16,15 @@ Arrow::Arrow(const Point &pos)
 {
 }
 
+Rect Arrow::getBoundingRect() const
+{
+    // the arrow tip is 10% of the line length (the arrowedLine() default)
+    int tipLength = (int) ceil(length() * 0.1);
+    const Point &head = getHead();
+    return rectUnion(Line::getBoundingRect(),
+                     padRect(Rect(head.x, head.y, 1, 1), tipLength + thickness / 2 + 2));
+}
+
 const char *Arrow::getType() const
 {
     return type;
@@ -22,7 +32,7 @@ const char *Arrow::getType() const
 
 void Arrow::draw(Mat &canvas)
 {
-    arrowedLine(canvas,(*pt1)(), (*pt2)(), outlineColor, thickness, lineType);
+    Painter::arrowedLine(canvas,(*pt1)(), (*pt2)(), outlineColor, thickness, lineType);
     CompoundShape::draw(canvas);
 }
 
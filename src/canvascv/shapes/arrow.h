@@ -15,6 +15,8 @@ class Arrow : public Line
 {
 public:
 
+    virtual cv::Rect getBoundingRect() const;
+
     virtual const char *getType() const;
 
     static const char * type;
@@ -0,0 +1,332 @@
+#include "binaryarchive.h"
+#include "shape.h"
+#include "shapefactory.h"
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+static const char FORMAT_TAG[4] = {'C', 'C', 'V', 'B'};
+
+// the color encodings
+enum ColorTag
+{
+    SAME_COLOR,  // equal to the previous color
+    BYTE_COLOR,  // 4 channels, each an integer in [0, 255]
+    FULL_COLOR   // 4 doubles
+};
+
+static bool sameBits(const Scalar &a, const Scalar &b)
+{
+    return memcmp(a.val, b.val, sizeof(a.val)) == 0;
+}
+
+static bool isByte(double value)
+{
+    return value >= 0 && value <= 255 && value == (int)value && ! signbit(value);
+}
+
+static void putU32(vector<uint8_t> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out.push_back((uint8_t)(value >> (i * 8)));
+    }
+}
+
+static void putVarint(vector<uint8_t> &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+BinaryWriter::BinaryWriter()
+    : lastColor(Scalar::all(0)),
+      lastPoint(0, 0),
+      lastId(0)
+{
+}
+
+void BinaryWriter::u8(uint8_t value)
+{
+    body.push_back(value);
+}
+
+void BinaryWriter::varint(uint64_t value)
+{
+    putVarint(body, value);
+}
+
+void BinaryWriter::svarint(int64_t value)
+{
+    // zigzag, so small negative values are small too
+    varint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+void BinaryWriter::f32(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    putU32(body, bits);
+}
+
+void BinaryWriter::f64(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    putU32(body, (uint32_t)bits);
+    putU32(body, (uint32_t)(bits >> 32));
+}
+
+void BinaryWriter::str(const string &value)
+{
+    varint(value.size());
+    body.insert(body.end(), value.begin(), value.end());
+}
+
+void BinaryWriter::color(const Scalar &value)
+{
+    if (sameBits(value, lastColor))
+    {
+        u8(SAME_COLOR);
+    }
+    else if (isByte(value[0]) && isByte(value[1]) && isByte(value[2]) && isByte(value[3]))
+    {
+        u8(BYTE_COLOR);
+        for (int i = 0; i < 4; ++i)
+        {
+            u8((uint8_t)value[i]);
+        }
+    }
+    else
+    {
+        u8(FULL_COLOR);
+        for (int i = 0; i < 4; ++i)
+        {
+            f64(value[i]);
+        }
+    }
+    lastColor = value;
+}
+
+void BinaryWriter::point(const Point &value)
+{
+    svarint((int64_t)value.x - lastPoint.x);
+    svarint((int64_t)value.y - lastPoint.y);
+    lastPoint = value;
+}
+
+void BinaryWriter::id(int value)
+{
+    svarint((int64_t)value - lastId);
+    lastId = value;
+}
+
+void BinaryWriter::shape(const Shape &shape)
+{
+    const char *type = shape.getType();
+    auto iter = typeIndex.find(type);
+    if (iter == typeIndex.end())
+    {
+        iter = typeIndex.insert(make_pair(type, (uint32_t)types.size())).first;
+        types.push_back(type);
+    }
+    varint(iter->second);
+    shape.writeBinaryInternals(*this);
+}
+
+void BinaryWriter::finish(vector<uint8_t> &out) const
+{
+    out.insert(out.end(), FORMAT_TAG, FORMAT_TAG + 4);
+    putU32(out, FORMAT_VERSION);
+    putVarint(out, types.size());
+    for (const char *type : types)
+    {
+        size_t size = strlen(type);
+        putVarint(out, size);
+        out.insert(out.end(), type, type + size);
+    }
+    out.insert(out.end(), body.begin(), body.end());
+}
+
+BinaryReader::BinaryReader(const uint8_t *data, size_t size)
+    : pos(data),
+      end(data + size),
+      valid(true),
+      lastColor(Scalar::all(0)),
+      lastPoint(0, 0),
+      lastId(0)
+{
+    if (! has(8) || memcmp(pos, FORMAT_TAG, 4) != 0)
+    {
+        fail();
+        return;
+    }
+    pos += 4;
+    uint32_t version = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        version |= (uint32_t)u8() << (i * 8);
+    }
+    if (version != BinaryWriter::FORMAT_VERSION) fail();
+
+    uint64_t typeCount = varint();
+    for (uint64_t i = 0; i < typeCount && valid; ++i)
+    {
+        types.push_back(str());
+        // newShape() can't create a type which isn't registered
+        if (! ShapeFactory::hasShape(types.back())) fail();
+    }
+}
+
+bool BinaryReader::ok() const
+{
+    return valid;
+}
+
+void BinaryReader::fail()
+{
+    valid = false;
+}
+
+bool BinaryReader::has(size_t size)
+{
+    valid = valid && (size_t)(end - pos) >= size;
+    return valid;
+}
+
+uint8_t BinaryReader::u8()
+{
+    if (! has(1)) return 0;
+    return *pos++;
+}
+
+uint64_t BinaryReader::varint()
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        uint8_t byte = u8();
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (! (byte & 0x80)) return value;
+    }
+    fail(); // too long for 64 bits
+    return 0;
+}
+
+int64_t BinaryReader::svarint()
+{
+    uint64_t value = varint();
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+int BinaryReader::i32()
+{
+    int64_t value = svarint();
+    if (value < INT32_MIN || value > INT32_MAX) fail();
+    return valid ? (int)value : 0;
+}
+
+float BinaryReader::f32()
+{
+    if (! has(4)) return 0;
+    uint32_t bits = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        bits |= (uint32_t)pos[i] << (i * 8);
+    }
+    pos += 4;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+double BinaryReader::f64()
+{
+    if (! has(8)) return 0;
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        bits |= (uint64_t)pos[i] << (i * 8);
+    }
+    pos += 8;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+string BinaryReader::str()
+{
+    uint64_t size = varint();
+    if (! has(size)) return string();
+    string value((const char*)pos, size);
+    pos += size;
+    return value;
+}
+
+Scalar BinaryReader::color()
+{
+    switch (u8())
+    {
+    case SAME_COLOR:
+        break;
+    case BYTE_COLOR:
+        for (int i = 0; i < 4; ++i)
+        {
+            lastColor[i] = u8();
+        }
+        break;
+    case FULL_COLOR:
+        for (int i = 0; i < 4; ++i)
+        {
+            lastColor[i] = f64();
+        }
+        break;
+    default:
+        fail();
+    }
+    return valid ? lastColor : Scalar::all(0);
+}
+
+Point BinaryReader::point()
+{
+    int64_t x = lastPoint.x + svarint();
+    int64_t y = lastPoint.y + svarint();
+    if (x < INT32_MIN || x > INT32_MAX || y < INT32_MIN || y > INT32_MAX) fail();
+    if (! valid) return Point(0, 0);
+    lastPoint = Point((int)x, (int)y);
+    return lastPoint;
+}
+
+int BinaryReader::id()
+{
+    int64_t value = lastId + svarint();
+    if (value < INT32_MIN || value > INT32_MAX) fail();
+    if (! valid) return 0;
+    lastId = (int)value;
+    return lastId;
+}
+
+Shape *BinaryReader::shape()
+{
+    uint64_t type = varint();
+    if (type >= types.size()) fail();
+    if (! valid) return nullptr;
+
+    unique_ptr<Shape> shape(ShapeFactory::newShape(types[type], Point(0, 0)));
+    shape->readBinaryInternals(*this);
+    ++shape->version;
+    return valid ? shape.release() : nullptr;
+}
+
+}
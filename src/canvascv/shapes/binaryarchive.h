@@ -0,0 +1,113 @@
+#ifndef BINARYARCHIVE_H
+#define BINARYARCHIVE_H
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace canvascv
+{
+
+class Shape;
+
+/**
+ * @brief The BinaryWriter class
+ *
+ * Writes shapes in the compact binary format of the Canvas (see Canvas::writeShapesToFile()),
+ * holding the same fields the FileStorage serialization holds:
+ * - Everything is little endian regardless of the machine.
+ * - The shape types are written once, in a type table, and shapes refer to them by index.
+ * - Integers are varints, and ids and points are written as the difference from the
+ *   previous id or point, which for the Handles of a shape is a byte or two.
+ * - Colors equal to the previous color take a byte, and integral 8 bit colors take 5 bytes.
+ *
+ * Shapes write their fields in Shape::writeBinaryInternals(), in the order they read them in
+ * Shape::readBinaryInternals().
+ */
+class BinaryWriter
+{
+public:
+    /// the version of the binary format
+    static const uint32_t FORMAT_VERSION = 1;
+
+    BinaryWriter();
+
+    void u8(uint8_t value);
+    void varint(uint64_t value);
+    void svarint(int64_t value);
+    void f32(float value);
+    void f64(double value);
+    void str(const std::string &value);
+    void color(const cv::Scalar &value);
+    void point(const cv::Point &value);
+    void id(int value);
+
+    /// the type of 'shape' followed by its fields
+    void shape(const Shape &shape);
+
+    /// append the header, the type table and everything written so far to 'out'
+    void finish(std::vector<uint8_t> &out) const;
+
+private:
+    std::vector<uint8_t> body;
+    std::vector<const char*> types;
+    std::map<const char*, uint32_t> typeIndex;
+    cv::Scalar lastColor;
+    cv::Point lastPoint;
+    int lastId;
+};
+
+/**
+ * @brief The BinaryReader class
+ *
+ * Reads what a BinaryWriter wrote. Reading past the end, reading invalid values or unregistered
+ * shape types fails the reader: ok() turns false and from then on all values read as 0 and
+ * shape() returns null.
+ */
+class BinaryReader
+{
+public:
+    /// reads the header and the type table of the data
+    BinaryReader(const uint8_t *data, size_t size);
+
+    bool ok() const;
+
+    /// fail the reader on values which can't be right
+    void fail();
+
+    uint8_t u8();
+    uint64_t varint();
+    int64_t svarint();
+    int i32(); ///< an svarint in the int range
+    float f32();
+    double f64();
+    std::string str();
+    cv::Scalar color();
+    cv::Point point();
+    int id();
+
+    /**
+     * @brief read a shape written by BinaryWriter::shape()
+     *
+     * @return a new shape (the caller owns it), or null if the reader failed
+     */
+    Shape *shape();
+
+private:
+    bool has(size_t size);
+
+    const uint8_t *pos;
+    const uint8_t *end;
+    bool valid;
+    std::vector<std::string> types;
+    cv::Scalar lastColor;
+    cv::Point lastPoint;
+    int lastId;
+};
+
+}
+
+#endif // BINARYARCHIVE_H
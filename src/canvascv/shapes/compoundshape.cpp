@@ -1,6 +1,8 @@
 #include "canvascv/colors.h"
 #include "handle.h"
 #include "compoundshape.h"
+#include "binaryarchive.h"
+#include "jsonwriter.h"
 
 #include <algorithm>
 
@@ -16,7 +18,7 @@ void CompoundShape::draw(Mat &canvas)
     {
         for (auto &shape : shapes)
         {
-            if (shape->getVisible())
+            if (shape->getVisible() && ! shape->isCulled(canvas))
             {
                 shape->draw(canvas);
             }
@@ -179,6 +181,16 @@ void CompoundShape::translate(const Point &offset)
     }
 }
 
+Rect CompoundShape::getBoundingRect() const
+{
+    Rect bounds;
+    for (auto &shape : shapes)
+    {
+        bounds = rectUnion(bounds, shape->getBoundingRect());
+    }
+    return bounds;
+}
+
 bool CompoundShape::rmvShape(Shape *shape)
 {
     auto i = find_if(shapes.begin(),shapes.end(),[shape](const shared_ptr<Shape> &item)->bool
@@ -193,6 +205,8 @@ bool CompoundShape::rmvShape(Shape *shape)
             active->lostFocus();
             active.reset();
         }
+        setDirty();
+        unindexSubShape(*shape);
         shapes.erase(i);
         return true;
     }
@@ -210,11 +224,21 @@ void CompoundShape::writeInternals(FileStorage &fs) const
     fs << "]";
 }
 
+void CompoundShape::writeJsonInternals(JsonWriter &out) const
+{
+    Shape::writeJsonInternals(out);
+    out.key("shapes");
+    out.beginArray();
+    for (auto &shape : shapes)
+    {
+        out.shape(*shape);
+    }
+    out.endArray();
+}
+
 void CompoundShape::readInternals(const FileNode &node)
 {
     Shape::readInternals(node);
-    active.reset();
-    shapes.clear();
     FileNode n = node["shapes"];
     FileNodeIterator it = n.begin(), it_end = n.end();
     list<Shape*> shapesTmp;
@@ -223,11 +247,64 @@ void CompoundShape::readInternals(const FileNode &node)
         Shape *shape = 0;
         it >> shape;
         assert(shape != 0);
-        shapes.push_back(shared_ptr<Shape>(shape));
         shapesTmp.push_back(shape);
     }
-    list<Shape*>::const_iterator i = shapesTmp.begin();
-    reloadPointers(shapesTmp, i);
+    setReadShapes(shapesTmp);
+}
+
+void CompoundShape::writeBinaryInternals(BinaryWriter &out) const
+{
+    Shape::writeBinaryInternals(out);
+    out.varint(shapes.size());
+    for (auto &shape : shapes)
+    {
+        out.shape(*shape);
+    }
+}
+
+void CompoundShape::readBinaryInternals(BinaryReader &in)
+{
+    Shape::readBinaryInternals(in);
+    uint64_t count = in.varint();
+    list<Shape*> shapesTmp;
+    for (uint64_t i = 0; i < count && in.ok(); ++i)
+    {
+        Shape *shape = in.shape();
+        if (shape) shapesTmp.push_back(shape);
+    }
+    if (! in.ok())
+    {
+        // the reader discards this shape, keep it whole until then
+        for (Shape *shape : shapesTmp)
+        {
+            delete shape;
+        }
+        return;
+    }
+    setReadShapes(shapesTmp);
+}
+
+void CompoundShape::setReadShapes(const list<Shape*> &shapesRead)
+{
+    active.reset();
+    for (auto &shape : shapes)
+    {
+        unindexSubShape(*shape);
+    }
+    shapes.clear();
+    for (Shape *shape : shapesRead)
+    {
+        shapes.push_back(ShapePool::share(shape));
+        adopt(*shape);
+        indexSubShape(shapes.back());
+    }
+    list<Shape*>::const_iterator i = shapesRead.begin();
+    reloadPointers(shapesRead, i);
+}
+
+void CompoundShape::getSubShapes(list<shared_ptr<Shape>> &result) const
+{
+    result.insert(result.end(), shapes.begin(), shapes.end());
 }
 
 void CompoundShape::setReady()
@@ -31,6 +31,9 @@ public:
     virtual std::shared_ptr<Shape> getShape(int id);
 
     virtual void translate(const cv::Point &offset);
+
+    /// union of all the internal shapes bounding rects
+    virtual cv::Rect getBoundingRect() const;
 protected:
     virtual ~CompoundShape() {} // force inheritance
 
@@ -58,10 +61,18 @@ protected:
 
     virtual void writeInternals(cv::FileStorage &fs) const;
     virtual void readInternals(const cv::FileNode &node);
+    virtual void writeJsonInternals(JsonWriter &out) const;
+    virtual void writeBinaryInternals(BinaryWriter &out) const;
+    virtual void readBinaryInternals(BinaryReader &in);
 
     virtual void setReady();
 
 private:
+    virtual void getSubShapes(std::list<std::shared_ptr<Shape>> &result) const;
+
+    /// replace the sub shapes with shapes which were just read
+    void setReadShapes(const std::list<Shape*> &shapesRead);
+
     std::shared_ptr<Shape> active;
     std::list<std::shared_ptr<Shape>> shapes;
 };
@@ -70,7 +81,10 @@ template <class T> inline
 T* CompoundShape::addShape(cv::Point pos)
 {
     T *ret = dynamic_cast<T*>(ShapeFactoryT<T>::newShape(pos));
-    shapes.push_back(std::shared_ptr<Shape>(ret));
+    shapes.push_back(ShapePool::share<Shape>(ret));
+    adopt(*ret);
+    indexSubShape(shapes.back());
+    setDirty();
     return ret;
 }
 
@@ -1,4 +1,5 @@
 #include "ellipse.h"
+#include "canvascv/painter.h"
 
 using namespace std;
 using namespace cv;
@@ -20,7 +21,7 @@ const char *Ellipse::getType() const
 
 void Ellipse::draw(Mat &canvas)
 {
-    ellipse(canvas, getRect(), outlineColor, thickness, lineType);
+    Painter::ellipse(canvas, getRect(), outlineColor, thickness, lineType);
     CompoundShape::draw(canvas);
 }
 
@@ -1,5 +1,8 @@
 #include "canvascv/colors.h"
 #include "handle.h"
+#include "binaryarchive.h"
+#include "jsonwriter.h"
+#include "canvascv/painter.h"
 #include "canvascv/canvas.h"
 
 #include <opencv2/imgproc.hpp>
@@ -34,8 +37,8 @@ void Handle::draw(Mat &canvas)
 {
     if (visible)
     {
-        circle(canvas, pt, thickness, fillColor, -1, lineType);
-        circle(canvas, pt, thickness, outlineColor, 1, lineType);
+        Painter::circle(canvas, pt, thickness, fillColor, -1, lineType);
+        Painter::circle(canvas, pt, thickness, outlineColor, 1, lineType);
     }
 }
 
@@ -64,12 +67,30 @@ void Handle::writeInternals(FileStorage &fs) const
     fs << "pt" << pt;
 }
 
+void Handle::writeJsonInternals(JsonWriter &out) const
+{
+    Shape::writeJsonInternals(out);
+    out.field("pt", pt);
+}
+
 void Handle::readInternals(const FileNode &node)
 {
     Shape::readInternals(node);
     node["pt"] >> pt;
 }
 
+void Handle::writeBinaryInternals(BinaryWriter &out) const
+{
+    Shape::writeBinaryInternals(out);
+    out.point(pt);
+}
+
+void Handle::readBinaryInternals(BinaryReader &in)
+{
+    Shape::readBinaryInternals(in);
+    pt = in.point();
+}
+
 // this is a private method.
 // validation done on public method of peer Handle.
 void Handle::connectedFrom(Handle &other)
@@ -151,6 +172,12 @@ list<Handle *> Handle::getConnectionTargets()
     return list<Handle *>();
 }
 
+Rect Handle::getBoundingRect() const
+{
+    int radius = thickness + 2; // outline and LINE_AA
+    return Rect(pt.x - radius, pt.y - radius, radius * 2 + 1, radius * 2 + 1);
+}
+
 const char *Handle::getType() const {
     return type;
 }
@@ -159,7 +186,11 @@ void Handle::setPos(const Point &pos, bool notify)
 {
     if (allowSetPos)
     {
-        pt = pos;
+        if (pt != pos)
+        {
+            pt = pos;
+            setDirty();
+        }
         if (notify)
         {
             broadcastPosChanged(pos);
@@ -170,7 +201,6 @@ void Handle::setPos(const Point &pos, bool notify)
 void Handle::translate(const Point &offset)
 {
     setPos(pt + offset);
-    if (canvas) canvas->setDirty();
 }
 
 int Handle::getRadius() const
@@ -62,6 +62,8 @@ public:
 
     virtual std::list<Handle *> getConnectionTargets();
 
+    virtual cv::Rect getBoundingRect() const;
+
     virtual const char *getType() const;
 
     static const char * type;
@@ -76,6 +78,9 @@ protected:
 
     virtual void writeInternals(cv::FileStorage &fs) const;
     virtual void readInternals(const cv::FileNode &node);
+    virtual void writeJsonInternals(JsonWriter &out) const;
+    virtual void writeBinaryInternals(BinaryWriter &out) const;
+    virtual void readBinaryInternals(BinaryReader &in);
 
     virtual void draw(cv::Mat &canvas);
     virtual bool mousePressed(const cv::Point &pos, bool = false);
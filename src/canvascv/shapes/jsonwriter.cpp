@@ -0,0 +1,276 @@
+#include "jsonwriter.h"
+#include "shape.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+JsonWriter::JsonWriter(ostream &out)
+    : stream(&out),
+      buffer(chunk),
+      capacity(CHUNK_SIZE),
+      used(0),
+      total(0),
+      failed(false),
+      hasValues(0),
+      depth(0),
+      afterKey(false)
+{
+}
+
+JsonWriter::JsonWriter(char *bufferVal, size_t capacityVal)
+    : stream(0),
+      buffer(bufferVal),
+      capacity(capacityVal),
+      used(0),
+      total(0),
+      failed(false),
+      hasValues(0),
+      depth(0),
+      afterKey(false)
+{
+}
+
+JsonWriter::~JsonWriter()
+{
+    flush();
+}
+
+bool JsonWriter::ok() const
+{
+    return ! failed;
+}
+
+size_t JsonWriter::size() const
+{
+    return total;
+}
+
+void JsonWriter::flush()
+{
+    if (stream && used)
+    {
+        stream->write(buffer, used);
+        used = 0;
+        if (! *stream) failed = true;
+    }
+}
+
+void JsonWriter::beginObject()
+{
+    separate();
+    put('{');
+    ++depth;
+    if (depth >= MAX_DEPTH) failed = true;
+}
+
+void JsonWriter::endObject()
+{
+    hasValues &= ~(1ull << (depth % MAX_DEPTH));
+    --depth;
+    put('}');
+}
+
+void JsonWriter::beginArray()
+{
+    separate();
+    put('[');
+    ++depth;
+    if (depth >= MAX_DEPTH) failed = true;
+}
+
+void JsonWriter::endArray()
+{
+    hasValues &= ~(1ull << (depth % MAX_DEPTH));
+    --depth;
+    put(']');
+}
+
+void JsonWriter::key(const char *name)
+{
+    separate();
+    quoted(name, strlen(name));
+    put(':');
+    afterKey = true;
+}
+
+void JsonWriter::value(bool value)
+{
+    // cv::FileStorage has no bools
+    separate();
+    put(value ? '1' : '0');
+}
+
+void JsonWriter::value(int value)
+{
+    separate();
+    char text[16];
+    int length = snprintf(text, sizeof(text), "%d", value);
+    put(text, length);
+}
+
+void JsonWriter::value(float value)
+{
+    separate();
+    number("%.9g", value);
+}
+
+void JsonWriter::value(double value)
+{
+    separate();
+    number("%.17g", value);
+}
+
+void JsonWriter::value(const char *value)
+{
+    separate();
+    quoted(value, strlen(value));
+}
+
+void JsonWriter::value(const std::string &value)
+{
+    separate();
+    quoted(value.c_str(), value.size());
+}
+
+void JsonWriter::value(const Scalar &value)
+{
+    beginArray();
+    for (int i = 0; i < 4; ++i)
+    {
+        this->value(value[i]);
+    }
+    endArray();
+}
+
+void JsonWriter::value(const Point &value)
+{
+    beginArray();
+    this->value(value.x);
+    this->value(value.y);
+    endArray();
+}
+
+void JsonWriter::shape(const Shape &shape)
+{
+    beginObject();
+    shape.writeJsonInternals(*this);
+    endObject();
+}
+
+void JsonWriter::document(const Shape &shape)
+{
+    beginObject();
+    key(shape.getType());
+    this->shape(shape);
+    endObject();
+}
+
+void JsonWriter::separate()
+{
+    if (afterKey)
+    {
+        afterKey = false;
+        return;
+    }
+    uint64_t bit = 1ull << (depth % MAX_DEPTH);
+    if (hasValues & bit) put(',');
+    hasValues |= bit;
+}
+
+void JsonWriter::put(char c)
+{
+    put(&c, 1);
+}
+
+void JsonWriter::put(const char *text, size_t length)
+{
+    total += length;
+    while (length)
+    {
+        if (used == capacity)
+        {
+            if (! stream)
+            {
+                failed = true;
+                return;
+            }
+            flush();
+        }
+        size_t count = min(length, capacity - used);
+        memcpy(buffer + used, text, count);
+        used += count;
+        text += count;
+        length -= count;
+    }
+}
+
+void JsonWriter::number(const char *format, double value)
+{
+    // non finite values are written the way cv::FileStorage writes them
+    if (std::isnan(value))
+    {
+        put(".Nan", 4);
+        return;
+    }
+    if (std::isinf(value))
+    {
+        if (value < 0) put("-.Inf", 5); else put(".Inf", 4);
+        return;
+    }
+    char text[32];
+    int length = snprintf(text, sizeof(text), format, value);
+    put(text, length);
+    // keep it a real number, so it isn't read back as an int
+    if (! strpbrk(text, ".eE")) put(".0", 2);
+}
+
+void JsonWriter::quoted(const char *value, size_t length)
+{
+    static const char *HEX = "0123456789abcdef";
+    put('"');
+    size_t start = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        unsigned char c = (unsigned char)value[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        put(value + start, i - start);
+        start = i + 1;
+        char escaped[6] = {'\\', (char)c, 0, 0, 0, 0};
+        size_t escapedLength = 2;
+        switch (c)
+        {
+        case '"':
+        case '\\':
+            break;
+        case '\n':
+            escaped[1] = 'n';
+            break;
+        case '\r':
+            escaped[1] = 'r';
+            break;
+        case '\t':
+            escaped[1] = 't';
+            break;
+        default:
+            escaped[1] = 'u';
+            escaped[2] = '0';
+            escaped[3] = '0';
+            escaped[4] = HEX[c >> 4];
+            escaped[5] = HEX[c & 0xf];
+            escapedLength = 6;
+            break;
+        }
+        put(escaped, escapedLength);
+    }
+    put(value + start, length - start);
+    put('"');
+}
+
+}
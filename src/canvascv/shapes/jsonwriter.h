@@ -0,0 +1,113 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace canvascv
+{
+
+class Shape;
+
+/**
+ * @brief The JsonWriter class
+ *
+ * Streams shapes as JSON with the same layout cv::FileStorage gives them in a json file
+ * (see Canvas::writeShapesToFile()), so its output can be read back by cv::FileStorage.
+ * It writes straight into an ostream or into a buffer of the caller, without allocating,
+ * which makes it cheap enough to log every shape change:
+ * - With an ostream the text goes through a small buffer inside the writer, which is
+ *   flushed to the ostream when it fills up, by flush() and by the destructor.
+ * - With a caller buffer nothing is written past its capacity. size() still counts all
+ *   the text, so a buffer of size() bytes fits it when ok() is false. The text isn't
+ *   null terminated.
+ *
+ * The output is compact (no white space), and bools are written as 0 and 1 like
+ * cv::FileStorage does. Shapes write their fields in Shape::writeJsonInternals().
+ */
+class JsonWriter
+{
+public:
+    /// stream into 'out'
+    explicit JsonWriter(std::ostream &out);
+
+    /// write into buffer, up to capacity bytes
+    JsonWriter(char *buffer, size_t capacity);
+
+    ~JsonWriter();
+
+    /// false if the caller buffer was too small or the ostream failed
+    bool ok() const;
+
+    /// the amount of bytes written (or that would have been written) so far
+    size_t size() const;
+
+    /// pass the buffered text to the ostream
+    void flush();
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    /// the key of the next value in an object
+    void key(const char *name);
+
+    void value(bool value);
+    void value(int value);
+    void value(float value);
+    void value(double value);
+    void value(const char *value);
+    void value(const std::string &value);
+    void value(const cv::Scalar &value);
+    void value(const cv::Point &value);
+
+    /// a key and its value
+    template <typename T>
+    void field(const char *name, const T &val)
+    {
+        key(name);
+        value(val);
+    }
+
+    /// the fields of 'shape' in an object
+    void shape(const Shape &shape);
+
+    /// a whole document of 'shape' under its type, as operator<<(std::ostream&, const Shape&) writes it
+    void document(const Shape &shape);
+
+private:
+    JsonWriter(const JsonWriter&) = delete;
+    JsonWriter &operator=(const JsonWriter&) = delete;
+
+    void separate();
+    void put(char c);
+    void put(const char *text, size_t length);
+    void number(const char *format, double value);
+    void quoted(const char *value, size_t length);
+
+    enum
+    {
+        CHUNK_SIZE = 512,
+        MAX_DEPTH = 64
+    };
+
+    std::ostream *stream;
+    char *buffer;
+    size_t capacity;
+    size_t used;
+    size_t total;
+    bool failed;
+    // a bit per nesting level, set once the level has a value (so the next needs a comma)
+    uint64_t hasValues;
+    int depth;
+    bool afterKey;
+    char chunk[CHUNK_SIZE];
+};
+
+}
+
+#endif // JSONWRITER_H
@@ -1,4 +1,5 @@
 #include "line.h"
+#include "canvascv/painter.h"
 #include <opencv2/imgproc.hpp>
 
 using namespace std;
@@ -15,11 +16,59 @@ Line::Line(const Point &pos)
     pt1->setLocked(true);
     pt1->setVisible(false);
     pt2 = addShape<Handle>(pos);
+    geometry.version = 0;
+}
+
+double Line::length() const
+{
+    return getGeometry().length;
+}
+
+bool Line::isPointOnLine(const Point &p3, int threshold) const
+{
+    threshold += thickness/2;
+    const Geometry &g = getGeometry();
+
+    // Make sure it is roughly on the line
+    if (threshold <= abs(g.a * p3.x + g.b * p3.y + g.c) / g.length)
+    {
+        return false;
+    }
+
+    // For p3 to be in p1<->p2 range, distance from p3 to either p1 or p2
+    //  cannot be more than distance from p1 to p2 (len).
+    for (const Point &end : {(*pt1)(), (*pt2)()})
+    {
+        int64_t dx = p3.x - end.x, dy = p3.y - end.y;
+        if (dx * dx + dy * dy > g.squaredLength)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const Line::Geometry &Line::getGeometry() const
+{
+    if (geometry.version != getVersion())
+    {
+        const Point &p1 = (*pt1)();
+        const Point &p2 = (*pt2)();
+        int64_t dx = p2.x - p1.x, dy = p2.y - p1.y;
+        geometry.a = dy;
+        geometry.b = -dx;
+        geometry.c = (int64_t)p2.x * p1.y - (int64_t)p2.y * p1.x;
+        geometry.squaredLength = dx * dx + dy * dy;
+        geometry.length = sqrt((double)geometry.squaredLength);
+        geometry.version = getVersion();
+    }
+    return geometry;
 }
 
 void Line::draw(Mat &canvas)
 {
-    line(canvas,(*pt1)(), (*pt2)(), outlineColor, thickness, lineType);
+    Painter::line(canvas,(*pt1)(), (*pt2)(), outlineColor, thickness, lineType);
     CompoundShape::draw(canvas);
 }
 
@@ -117,6 +166,12 @@ list<Handle *> Line::getConnectionTargets()
     return {pt1, pt2};
 }
 
+Rect Line::getBoundingRect() const
+{
+    return rectUnion(CompoundShape::getBoundingRect(),
+                     lineBoundingRect(getTail(), getHead(), thickness));
+}
+
 const char *Line::getType() const
 {
    return type;
@@ -5,7 +5,9 @@
 #include "shapefactory.h"
 #include "handle.h"
 
-#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <cstdint>
 
 namespace canvascv
 {
@@ -37,41 +39,10 @@ public:
     void setHeadPos(const cv::Point& pos);
 
     /// returns the length of the line in pixels
-    double length() const {
-        const cv::Point &p1 = (*pt1)();
-        const cv::Point &p2 = (*pt2)();
-        return sqrt(pow(p2.y-p1.y,2)+pow(p2.x-p1.x,2));
-    }
+    double length() const;
 
     /// returns true if the point 'p3' is on the line, give or take 'threshold' pixels
-    bool isPointOnLine(const cv::Point &p3, int threshold=3) const
-    {
-        threshold += thickness/2;
-        const cv::Point &p1 = (*pt1)();
-        const cv::Point &p2 = (*pt2)();
-        double len = length();
-
-        // Make sure it is roughly on the line
-        if (threshold <= abs((p2.y-p1.y)*p3.x-(p2.x-p1.x)*p3.y+p2.x*p1.y-p2.y*p1.x) / len)
-        {
-            return false;
-        }
-
-        // For p3 to be in p1<->p2 range, distance from p3 to either p1 or p2
-        //  cannot be more than distance from p1 to p2 (len).
-
-        if(sqrt(pow(p3.y-p1.y,2)+pow(p3.x-p1.x,2)) > len)
-        {
-            return false;
-        }
-
-        if(sqrt(pow(p3.y-p2.y,2)+pow(p3.x-p2.x,2)) > len)
-        {
-            return false;
-        }
-
-        return true;
-    }
+    bool isPointOnLine(const cv::Point &p3, int threshold=3) const;
 
     /// get the Handle to the tail of the
     Handle &getPT1();
@@ -94,6 +65,8 @@ public:
 
     virtual std::list<Handle *> getConnectionTargets();
 
+    virtual cv::Rect getBoundingRect() const;
+
     virtual const char *getType() const;
 
     static const char * type;
@@ -113,6 +86,20 @@ protected:
     Handle* pt2;
 
     virtual void reloadPointers(const std::list<Shape*> &lst, std::list<Shape*>::const_iterator &i);
+
+private:
+    /// the line equation a*x + b*y + c = 0 and length, as of 'version'
+    struct Geometry
+    {
+        unsigned version;
+        int64_t a, b, c;
+        int64_t squaredLength;
+        double length;
+    };
+
+    const Geometry &getGeometry() const;
+
+    mutable Geometry geometry;
 };
 
 }
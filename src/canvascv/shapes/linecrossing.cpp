@@ -1,4 +1,6 @@
 #include "linecrossing.h"
+#include "binaryarchive.h"
+#include "jsonwriter.h"
 #include <opencv2/imgproc.hpp>
 
 using namespace std;
@@ -23,7 +25,7 @@ LineCrossing::LineCrossing(const Point &pos)
     setActive(line);
 }
 
-void LineCrossing::draw(Mat &canvas)
+void LineCrossing::updatePartsVisibility()
 {
     if (line->length()<10)
     {
@@ -35,7 +37,15 @@ void LineCrossing::draw(Mat &canvas)
         arrow->getPT1().setVisible(false);
         arrow->getPT2().setVisible(false);
     }
-    CompoundShape::draw(canvas);
+}
+
+void LineCrossing::setVisible(bool value)
+{
+    CompoundShape::setVisible(value);
+    if (value)
+    {
+        updatePartsVisibility();
+    }
 }
 
 bool LineCrossing::mousePressed(const Point &pos, bool onCreate)
@@ -71,11 +81,13 @@ void LineCrossing::registerCBs()
     {
         recalcArrow();
         recalcTextBox();
+        if (visible) updatePartsVisibility();
     });
     line->getPT2().addPosChangedCB([this](const Point &)
     {
         recalcArrow();
         recalcTextBox();
+        if (visible) updatePartsVisibility();
     });
 }
 
@@ -129,11 +141,33 @@ void LineCrossing::writeInternals(FileStorage &fs) const
     fs << "direction" << direction;
 }
 
+void LineCrossing::writeJsonInternals(JsonWriter &out) const
+{
+    CompoundShape::writeJsonInternals(out);
+    out.field("direction", direction);
+}
+
 void LineCrossing::readInternals(const FileNode &node)
 {
     CompoundShape::readInternals(node);
     node["direction"] >> direction;
     registerCBs();
+    if (visible) updatePartsVisibility();
+}
+
+void LineCrossing::writeBinaryInternals(BinaryWriter &out) const
+{
+    CompoundShape::writeBinaryInternals(out);
+    out.svarint(direction);
+}
+
+void LineCrossing::readBinaryInternals(BinaryReader &in)
+{
+    CompoundShape::readBinaryInternals(in);
+    direction = in.i32();
+    if (! in.ok()) return;
+    registerCBs();
+    if (visible) updatePartsVisibility();
 }
 
 void LineCrossing::reloadPointers(const list<Shape *> &lst, list<Shape*>::const_iterator &i)
@@ -68,6 +68,7 @@ public:
      * -  0 if the segments are not crossing
      * -  1 if the segment crossed according to direction
      * - -1 if the segment crossed against the direction
+     * @see LineCrossingBatch to test many segments against many lines
      */
     int isCrossedBySegment(const Point &lineStart, const Point &lineEnd) const;
 
@@ -77,6 +78,7 @@ public:
     }
 
     virtual std::list<Handle *> getConnectionTargets();
+    virtual void setVisible(bool value);
     virtual const char *getType() const;
     static const char * type;
 
@@ -86,11 +88,13 @@ protected:
 
     LineCrossing(const cv::Point& pos);
 
-    virtual void draw(cv::Mat &canvas);
     virtual bool mousePressed(const cv::Point &pos, bool onCreate = false);
 
     void registerCBs();
 
+    /// the arrow and TextBox are shown only when the line is long enough
+    void updatePartsVisibility();
+
     void recalcArrow();
 
     void recalcTextBox();
@@ -103,6 +107,9 @@ protected:
 
     virtual void writeInternals(cv::FileStorage &fs) const;
     virtual void readInternals(const cv::FileNode &node);
+    virtual void writeJsonInternals(JsonWriter &out) const;
+    virtual void writeBinaryInternals(BinaryWriter &out) const;
+    virtual void readBinaryInternals(BinaryReader &in);
 
     virtual void reloadPointers(const std::list<Shape*> &lst, std::list<Shape*>::const_iterator &i);
 
@@ -0,0 +1,175 @@
+#include "linecrossingbatch.h"
+#include "linecrossing.h"
+
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+// segments per parallel_for_ range
+static const int BLOCK_SIZE = 256;
+
+class LineCrossingBatch::ParallelProcess : public ParallelLoopBody
+{
+public:
+    ParallelProcess(const vector<Coeffs> &linesVal, const Segment *segmentsVal, int countVal,
+                    vector<vector<Event>> &blockEventsVal)
+        : lines(linesVal), segments(segmentsVal), count(countVal), blockEvents(blockEventsVal) {}
+
+    virtual void operator()(const Range &range) const
+    {
+        vector<int> soa(BLOCK_SIZE * 4);
+        for (int block = range.start; block < range.end; ++block)
+        {
+            int first = block * BLOCK_SIZE;
+            int n = min(BLOCK_SIZE, count - first);
+            int *sx = &soa[0], *sy = sx + BLOCK_SIZE, *ex = sy + BLOCK_SIZE, *ey = ex + BLOCK_SIZE;
+            for (int i = 0; i < n; ++i)
+            {
+                const Segment &segment = segments[first + i];
+                sx[i] = segment.start.x;
+                sy[i] = segment.start.y;
+                ex[i] = segment.end.x;
+                ey[i] = segment.end.y;
+            }
+
+            vector<Event> &events = blockEvents[block];
+            for (int l = 0; l < (int)lines.size(); ++l)
+            {
+                int i = useOptimized() ? processSIMD(lines[l], sx, sy, ex, ey, n, first, l, events) : 0;
+                for (; i < n; ++i)
+                {
+                    int direction = crossing(lines[l], sx[i], sy[i], ex[i], ey[i]);
+                    if (direction) events.push_back({first + i, l, direction});
+                }
+            }
+            sort(events.begin(), events.end(), [](const Event &a, const Event &b)
+            {
+                return a.segment < b.segment || (a.segment == b.segment && a.line < b.line);
+            });
+        }
+    }
+
+private:
+    // the same tests as LineCrossing::isCrossedBySegment()
+    static inline int crossing(const Coeffs &line, int sx, int sy, int ex, int ey)
+    {
+        int z1 = line.dx * (sy - line.ty) - line.dy * (sx - line.tx);
+        int z2 = line.dx * (ey - line.ty) - line.dy * (ex - line.tx);
+        int direction;
+        if (z1 >= 0 && z2 <= 0)
+        {
+            direction = 1;
+        }
+        else if (z2 >= 0 && z1 <= 0)
+        {
+            direction = -1;
+        }
+        else
+        {
+            return 0;
+        }
+        // are the line end points on different sides of the segment?
+        int bx = ex - sx, by = ey - sy;
+        int z3 = bx * (line.ty - sy) - by * (line.tx - sx);
+        int z4 = bx * (line.hy - sy) - by * (line.hx - sx);
+        return ((z3 <= 0 && z4 >= 0) || (z4 <= 0 && z3 >= 0)) ? direction : 0;
+    }
+
+#if CV_SIMD128
+    // handles 4 segments at a time and returns how many segments it handled
+    static int processSIMD(const Coeffs &line, const int *sx, const int *sy, const int *ex, const int *ey,
+                           int n, int first, int l, vector<Event> &events)
+    {
+        const v_int32x4 zero = v_setzero_s32(), one = v_setall_s32(1), minusOne = v_setall_s32(-1);
+        const v_int32x4 tx = v_setall_s32(line.tx), ty = v_setall_s32(line.ty);
+        const v_int32x4 hx = v_setall_s32(line.hx), hy = v_setall_s32(line.hy);
+        const v_int32x4 dx = v_setall_s32(line.dx), dy = v_setall_s32(line.dy);
+        int i = 0;
+        for (; i <= n - 4; i += 4)
+        {
+            v_int32x4 vsx = v_load(sx + i), vsy = v_load(sy + i);
+            v_int32x4 vex = v_load(ex + i), vey = v_load(ey + i);
+            v_int32x4 z1 = dx * (vsy - ty) - dy * (vsx - tx);
+            v_int32x4 z2 = dx * (vey - ty) - dy * (vex - tx);
+            v_int32x4 with = (z1 >= zero) & (z2 <= zero);
+            v_int32x4 against = (z2 >= zero) & (z1 <= zero) & ~with;
+
+            v_int32x4 bx = vex - vsx, by = vey - vsy;
+            v_int32x4 z3 = bx * (ty - vsy) - by * (tx - vsx);
+            v_int32x4 z4 = bx * (hy - vsy) - by * (hx - vsx);
+            v_int32x4 straddle = ((z3 <= zero) & (z4 >= zero)) | ((z4 <= zero) & (z3 >= zero));
+
+            v_int32x4 direction = ((with & one) | (against & minusOne)) & straddle;
+            if (v_check_any(direction != zero))
+            {
+                int directions[4];
+                v_store(directions, direction);
+                for (int j = 0; j < 4; ++j)
+                {
+                    if (directions[j]) events.push_back({first + i + j, l, directions[j]});
+                }
+            }
+        }
+        return i;
+    }
+#else
+    static int processSIMD(const Coeffs &, const int *, const int *, const int *, const int *,
+                           int, int, int, vector<Event> &)
+    {
+        return 0;
+    }
+#endif
+
+    const vector<Coeffs> &lines;
+    const Segment *segments;
+    int count;
+    vector<vector<Event>> &blockEvents;
+};
+
+void LineCrossingBatch::setLines(const vector<LineCrossing*> &value)
+{
+    lines = value;
+}
+
+const vector<LineCrossing*> &LineCrossingBatch::getLines() const
+{
+    return lines;
+}
+
+void LineCrossingBatch::process(const Segment *segments, int count, vector<Event> &events) const
+{
+    events.clear();
+    if (count <= 0 || lines.empty()) return;
+
+    vector<Coeffs> coeffs;
+    coeffs.reserve(lines.size());
+    for (LineCrossing *line : lines)
+    {
+        const Point &tail = line->getTail();
+        const Point &head = line->getHead();
+        int direction = line->getDirection();
+        coeffs.push_back({tail.x, tail.y, head.x, head.y,
+                          (head.x - tail.x) * direction, (head.y - tail.y) * direction});
+    }
+
+    int blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    vector<vector<Event>> blockEvents(blocks);
+    parallel_for_(Range(0, blocks), ParallelProcess(coeffs, segments, count, blockEvents));
+    for (auto &block : blockEvents)
+    {
+        events.insert(events.end(), block.begin(), block.end());
+    }
+}
+
+void LineCrossingBatch::process(const vector<Segment> &segments, vector<Event> &events) const
+{
+    process(segments.data(), (int)segments.size(), events);
+}
+
+}
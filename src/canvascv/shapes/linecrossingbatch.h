@@ -0,0 +1,80 @@
+#ifndef LINECROSSINGBATCH_H
+#define LINECROSSINGBATCH_H
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+namespace canvascv
+{
+
+class LineCrossing;
+
+/**
+ * @brief The LineCrossingBatch class
+ *
+ * Tests all the track segments of a frame against many LineCrossing shapes at once, with
+ * the same results as calling LineCrossing::isCrossedBySegment() for each pair.
+ *
+ * The lines coefficients are computed once per process() call, the segments are tested
+ * 4 at a time with the OpenCV universal intrinsics, and blocks of segments are spread
+ * over the cores with cv::parallel_for_. A batch can be shared by several threads
+ * (e.g. one per stream) as long as the lines aren't changed while it is processing.
+ */
+class LineCrossingBatch
+{
+public:
+    /// a tracked object moving from 'start' to 'end' during a frame
+    struct Segment
+    {
+        cv::Point start;
+        cv::Point end;
+    };
+
+    /// a segment which crossed a line
+    struct Event
+    {
+        int segment;   ///< index into the segments given to process()
+        int line;      ///< index into the lines given to setLines()
+        int direction; ///< 1 with the line direction arrow, -1 against it
+    };
+
+    /**
+     * @brief setLines
+     *
+     * @param value are the lines to test against. They are kept as pointers, so remove deleted
+     * lines with another setLines() call (e.g. from Canvas::notifyOnShapeDelete()).
+     */
+    void setLines(const std::vector<LineCrossing*> &value);
+
+    const std::vector<LineCrossing*> &getLines() const;
+
+    /**
+     * @brief process
+     *
+     * @param segments is a contiguous array of the frame track segments
+     * @param count is the amount of segments
+     * @param events is cleared and filled with the crossings, sorted by segment and then line
+     */
+    void process(const Segment *segments, int count, std::vector<Event> &events) const;
+
+    /// process() all the segments of a vector
+    void process(const std::vector<Segment> &segments, std::vector<Event> &events) const;
+
+private:
+    /// a line, with the direction folded into its vector
+    struct Coeffs
+    {
+        int tx, ty; ///< tail
+        int hx, hy; ///< head
+        int dx, dy; ///< (head - tail) * direction
+    };
+
+    class ParallelProcess;
+
+    std::vector<LineCrossing*> lines;
+};
+
+}
+
+#endif // LINECROSSINGBATCH_H
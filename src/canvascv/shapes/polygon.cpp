@@ -1,4 +1,5 @@
 #include "polygon.h"
+#include "canvascv/painter.h"
 
 using namespace std;
 using namespace cv;
@@ -22,11 +23,11 @@ void Polygon::draw(Mat &canvas)
     auto nextIter = next(iter);
     for (; nextIter != handles.end(); ++iter, ++nextIter)
     {
-        line(canvas,(**iter)(), (**nextIter)(), outlineColor, thickness, lineType);
+        Painter::line(canvas,(**iter)(), (**nextIter)(), outlineColor, thickness, lineType);
     }
     if (isReady())
     {
-        line(canvas,(*handles.back())(), (*handles.front())(), outlineColor, thickness, lineType);
+        Painter::line(canvas,(*handles.back())(), (*handles.front())(), outlineColor, thickness, lineType);
     }
     CompoundShape::draw(canvas);
 }
@@ -148,6 +149,16 @@ list<Handle *> Polygon::getConnectionTargets()
     return handles;
 }
 
+Rect Polygon::getBoundingRect() const
+{
+    Rect bounds = CompoundShape::getBoundingRect();
+    for (Handle *handle : handles)
+    {
+        bounds = rectUnion(bounds, lineBoundingRect((*handle)(), (*handle)(), thickness));
+    }
+    return bounds;
+}
+
 const char *Polygon::getType() const
 {
     return type;
@@ -20,10 +20,9 @@ public:
     /// returns true if pos is in the polygon
     bool isPointInPoly(const cv::Point &pos) const
     {
-        if (isReady())
+        if (isReady() && getBounds().contains(pos))
         {
             return cv::pointPolygonTest(vertices, pos, false) >= 0;
-
         }
         return false;
     }
@@ -46,6 +45,8 @@ public:
     virtual bool keyPressed(int &key);
     virtual void translate(const cv::Point &offset);
 
+    virtual cv::Rect getBoundingRect() const;
+
     virtual const char *getType() const;
 
     static const char * type;
@@ -1,4 +1,7 @@
 #include "rectangle.h"
+#include "binaryarchive.h"
+#include "jsonwriter.h"
+#include "canvascv/painter.h"
 
 using namespace std;
 using namespace cv;
@@ -24,6 +27,7 @@ Rectangle::Rectangle(const Point &pos)
     height = 3;
     angle = 0;
     selfUpdate = false;
+    geometry.version = 0;
     updatePoints();
     registerCBs();
     setActive(pt3);
@@ -31,10 +35,10 @@ Rectangle::Rectangle(const Point &pos)
 
 void Rectangle::draw(Mat &canvas)
 {
-    line(canvas, (*pt1)(), (*pt2)(), outlineColor, thickness, lineType);
-    line(canvas, (*pt2)(), (*pt3)(), outlineColor, thickness, lineType);
-    line(canvas, (*pt3)(), (*pt4)(), outlineColor, thickness, lineType);
-    line(canvas, (*pt4)(), (*pt1)(), outlineColor, thickness, lineType);
+    Painter::line(canvas, (*pt1)(), (*pt2)(), outlineColor, thickness, lineType);
+    Painter::line(canvas, (*pt2)(), (*pt3)(), outlineColor, thickness, lineType);
+    Painter::line(canvas, (*pt3)(), (*pt4)(), outlineColor, thickness, lineType);
+    Painter::line(canvas, (*pt4)(), (*pt1)(), outlineColor, thickness, lineType);
     CompoundShape::draw(canvas);
 }
 
@@ -260,6 +264,14 @@ void Rectangle::writeInternals(FileStorage &fs) const
     fs << "angle" << angle;
 }
 
+void Rectangle::writeJsonInternals(JsonWriter &out) const
+{
+    CompoundShape::writeJsonInternals(out);
+    out.field("width", width);
+    out.field("height", height);
+    out.field("angle", angle);
+}
+
 void Rectangle::readInternals(const FileNode &node)
 {
     CompoundShape::readInternals(node);
@@ -268,6 +280,22 @@ void Rectangle::readInternals(const FileNode &node)
     node["angle"] >> angle;
 }
 
+void Rectangle::writeBinaryInternals(BinaryWriter &out) const
+{
+    CompoundShape::writeBinaryInternals(out);
+    out.f32(width);
+    out.f32(height);
+    out.f32(angle);
+}
+
+void Rectangle::readBinaryInternals(BinaryReader &in)
+{
+    CompoundShape::readBinaryInternals(in);
+    width = in.f32();
+    height = in.f32();
+    angle = in.f32();
+}
+
 void Rectangle::reloadPointers(const list<Shape *> &lst, list<Shape*>::const_iterator &i)
 {
     CompoundShape::reloadPointers(lst, i);
@@ -288,6 +316,61 @@ list<Handle *> Rectangle::getConnectionTargets()
     return {rotate1, rotate2, rotate3, rotate4};
 }
 
+bool Rectangle::isPointInRectangle(Point pos) const
+{
+    const Geometry &g = getGeometry();
+    if (pos.x < g.box.x || pos.y < g.box.y ||
+            pos.x >= g.box.x + g.box.width || pos.y >= g.box.y + g.box.height)
+    {
+        return false;
+    }
+    // the corners are in order, so pos is inside (or on an edge) when it
+    // isn't on both sides of the edges
+    bool left = false, right = false;
+    for (int i = 0; i < 4; ++i)
+    {
+        int64_t side = g.nx[i] * pos.x + g.ny[i] * pos.y - g.d[i];
+        left |= side < 0;
+        right |= side > 0;
+    }
+    return ! (left && right);
+}
+
+const Rectangle::Geometry &Rectangle::getGeometry() const
+{
+    if (geometry.version != getVersion())
+    {
+        const Point corners[4] = {(*pt1)(), (*pt2)(), (*pt3)(), (*pt4)()};
+        int minX = corners[0].x, minY = corners[0].y, maxX = minX, maxY = minY;
+        for (int i = 0; i < 4; ++i)
+        {
+            const Point &from = corners[i];
+            const Point &to = corners[(i + 1) % 4];
+            int64_t ex = to.x - from.x, ey = to.y - from.y;
+            geometry.nx[i] = -ey;
+            geometry.ny[i] = ex;
+            geometry.d[i] = ex * from.y - ey * from.x;
+            minX = min(minX, from.x);
+            minY = min(minY, from.y);
+            maxX = max(maxX, from.x);
+            maxY = max(maxY, from.y);
+        }
+        geometry.box = Rect(minX, minY, maxX - minX + 1, maxY - minY + 1);
+        geometry.version = getVersion();
+    }
+    return geometry;
+}
+
+Rect Rectangle::getBoundingRect() const
+{
+    Rect bounds = CompoundShape::getBoundingRect();
+    for (auto &pt : {pt1, pt2, pt3, pt4})
+    {
+        bounds = rectUnion(bounds, lineBoundingRect((*pt)(), (*pt)(), thickness));
+    }
+    return bounds;
+}
+
 const char *Rectangle::getType() const {
     return type;
 }
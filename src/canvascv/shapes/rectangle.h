@@ -4,6 +4,8 @@
 #include "compoundshape.h"
 #include "handle.h"
 
+#include <cstdint>
+
 namespace canvascv
 {
 
@@ -25,15 +27,7 @@ public:
     virtual bool keyPressed(int &key);
 
     /// returns true if pos is in the rectangle representated by this shape
-    bool isPointInRectangle(cv::Point pos)
-    {
-        std::vector<Point> pts(4);
-        pts[0] = (*pt1)();
-        pts[1] = (*pt2)();
-        pts[2] = (*pt3)();
-        pts[3] = (*pt4)();
-        return cv::pointPolygonTest(pts, pos, false) >= 0;
-    }
+    bool isPointInRectangle(cv::Point pos) const;
 
     virtual bool isAtPos(const cv::Point &pos)
     {
@@ -44,6 +38,8 @@ public:
 
     virtual void translate(const cv::Point &offset);
 
+    virtual cv::Rect getBoundingRect() const;
+
     virtual const char *getType() const;
 
     static const char * type;
@@ -61,6 +57,18 @@ protected:
     virtual const string &getEditStatusMsg() const;
 
 private:
+    /// the corners geometry, derived from the handles as of 'version'
+    struct Geometry
+    {
+        unsigned version;
+        cv::Rect box;          ///< axis aligned bounds of the corners (edges included)
+        int64_t nx[4];         ///< edge i equation: nx*x + ny*y - d,
+        int64_t ny[4];         ///< zero on the edge and of the same sign
+        int64_t d[4];          ///< for all the edges inside the rectangle
+    };
+
+    const Geometry &getGeometry() const;
+
     void recalcRect(const cv::Point &pos, bool rotated = false, float offset = 0);
 
     void updatePoints();
@@ -80,9 +88,13 @@ private:
     float height;
     float angle; // in radians
     bool selfUpdate;
+    mutable Geometry geometry;
 
     virtual void writeInternals(cv::FileStorage &fs) const;
     virtual void readInternals(const cv::FileNode &node);
+    virtual void writeJsonInternals(JsonWriter &out) const;
+    virtual void writeBinaryInternals(BinaryWriter &out) const;
+    virtual void readBinaryInternals(BinaryReader &in);
 
     virtual void reloadPointers(const std::list<Shape*> &lst, std::list<Shape*>::const_iterator &i);
 };
@@ -1,7 +1,13 @@
 #include "shape.h"
+#include "binaryarchive.h"
+#include "jsonwriter.h"
 #include "shapefactory.h"
+#include "shapepool.h"
 #include "canvascv/canvas.h"
 
+#include <atomic>
+#include <climits>
+
 using namespace std;
 using namespace cv;
 
@@ -37,7 +43,12 @@ Shape::Shape()
       lineType(cv::LINE_AA),
       canvas(nullptr),
       deleted(false),
-      ready(false)
+      ready(false),
+      parent(nullptr),
+      damaged(false),
+      version(1),
+      boundsVersion(0),
+      slot(0)
 {}
 
 Shape::Shape(const Shape &other)
@@ -51,13 +62,28 @@ Shape::Shape(const Shape &other)
       lineType(other.lineType),
       canvas(other.canvas),
       deleted(other.deleted),
-      ready(other.ready)
+      ready(other.ready),
+      parent(nullptr),
+      damaged(false),
+      version(1),
+      boundsVersion(0),
+      slot(0)
 {}
 
 Shape::~Shape()
 {
 }
 
+void *Shape::operator new(size_t size)
+{
+    return ShapePool::allocate(size);
+}
+
+void Shape::operator delete(void *p, size_t size)
+{
+    ShapePool::deallocate(p, size);
+}
+
 void Shape::notifyOnEvent(Shape::CBPerShape cb)
 {
     cbs.push_back(cb);
@@ -72,7 +98,7 @@ void Shape::setOutlineColor(const Scalar &value)
 {
     outlineColor = value;
     outlineColor[3] = 255; // shape colors are opaque
-    if (canvas) canvas->setDirty();
+    setDirty();
 }
 
 Scalar Shape::getFillColor() const
@@ -84,7 +110,7 @@ void Shape::setFillColor(const Scalar &value)
 {
     fillColor = value;
     fillColor[3] = 255; // shape colors are opaque
-    if (canvas) canvas->setDirty();
+    setDirty();
 }
 
 bool Shape::getLocked() const
@@ -105,7 +131,7 @@ bool Shape::getVisible() const
 void Shape::setVisible(bool value)
 {
     visible = value;
-    if (canvas) canvas->setDirty();
+    setDirty();
 }
 
 int Shape::getThickness() const
@@ -116,7 +142,7 @@ int Shape::getThickness() const
 void Shape::setThickness(int value)
 {
     thickness = value;
-    if (canvas) canvas->setDirty();
+    setDirty();
 }
 
 int Shape::getLineType() const
@@ -127,7 +153,7 @@ int Shape::getLineType() const
 void Shape::setLineType(int value)
 {
     lineType = value;
-    if (canvas) canvas->setDirty();
+    setDirty();
 }
 
 void Shape::drawHelper(Mat &canvas, Shape *other)
@@ -135,11 +161,87 @@ void Shape::drawHelper(Mat &canvas, Shape *other)
     other->draw(canvas);
 }
 
+bool Shape::isCulled(const Mat &canvas) const
+{
+    Canvas *rootCanvas = getRootCanvas();
+    if (rootCanvas) return rootCanvas->cull(getBounds(), canvas);
+    return ! rectsIntersect(getBounds(), Rect(Point(0, 0), canvas.size()));
+}
+
 void Shape::setCanvas(Canvas &value)
 {
     canvas = &value;
 }
 
+void Shape::setDirty()
+{
+    Shape *root = this;
+    ++root->version;
+    while (root->parent)
+    {
+        root = root->parent;
+        ++root->version;
+    }
+    if (root->canvas) root->canvas->setDirty(*root);
+}
+
+Canvas *Shape::getRootCanvas() const
+{
+    const Shape *root = this;
+    while (root->parent)
+    {
+        root = root->parent;
+    }
+    return root->canvas;
+}
+
+void Shape::indexSubShape(const std::shared_ptr<Shape> &child)
+{
+    Canvas *rootCanvas = getRootCanvas();
+    if (rootCanvas) rootCanvas->indexIds(child);
+}
+
+void Shape::unindexSubShape(Shape &child)
+{
+    Canvas *rootCanvas = getRootCanvas();
+    if (rootCanvas) rootCanvas->unindexIds(child);
+}
+
+void Shape::getSubShapes(std::list<std::shared_ptr<Shape>> &) const
+{
+    // no sub shapes by default
+}
+
+void Shape::adopt(Shape &child)
+{
+    child.parent = this;
+}
+
+Rect Shape::getBoundingRect() const
+{
+    return Rect(INT_MIN / 2, INT_MIN / 2, INT_MAX, INT_MAX);
+}
+
+const Rect &Shape::getBounds() const
+{
+    if (boundsVersion != version)
+    {
+        bounds = getBoundingRect();
+        boundsVersion = version;
+    }
+    return bounds;
+}
+
+unsigned Shape::getVersion() const
+{
+    return version;
+}
+
+void Shape::updateDrawnBounds()
+{
+    drawnBounds = visible ? getBounds() : Rect();
+}
+
 const string &Shape::getStatusMsg() const
 {
     const static string lockedMsg = "Shape is locked.";
@@ -215,9 +317,11 @@ void Shape::broadcastEvent(Event event)
     }
 }
 
+// shapes may be created on several threads at once (see read() of a Canvas)
+static atomic<int> idGenerator(0);
+
 int Shape::genId()
 {
-    static int idGenerator;
     return ++idGenerator;
 }
 
@@ -231,6 +335,7 @@ void Shape::write(FileStorage& fs) const
 void Shape::read(const FileNode& node)
 {
     readInternals(node);
+    ++version;
 }
 
 void Shape::readInternals(const FileNode &node)
@@ -244,17 +349,7 @@ void Shape::readInternals(const FileNode &node)
     node["lineType"] >> lineType;
     node["ready"] >> ready;
     editing = false;
-    if (id == 0)
-    {
-        // backward compatible for old config files
-        id = genId();
-    }
-    else
-    {
-        // ensure no duplicate ids.
-        // new generated ids will always be bigger than ones in files.
-        while (genId() < id) {}
-    }
+    reserveId();
 }
 
 void Shape::writeInternals(FileStorage &fs) const
@@ -270,11 +365,64 @@ void Shape::writeInternals(FileStorage &fs) const
           "ready" << ready;
 }
 
+void Shape::writeJsonInternals(JsonWriter &out) const
+{
+    out.field("XXXconcreteTypeXXX", getType());
+    out.field("id", id);
+    out.field("outlineColor", outlineColor);
+    out.field("fillColor", fillColor);
+    out.field("locked", locked);
+    out.field("visible", visible);
+    out.field("thickness", thickness);
+    out.field("lineType", lineType);
+    out.field("ready", ready);
+}
+
+void Shape::writeBinaryInternals(BinaryWriter &out) const
+{
+    out.id(id);
+    out.color(outlineColor);
+    out.color(fillColor);
+    out.u8((locked ? 1 : 0) | (visible ? 2 : 0) | (ready ? 4 : 0));
+    out.svarint(thickness);
+    out.svarint(lineType);
+}
+
+void Shape::readBinaryInternals(BinaryReader &in)
+{
+    id = in.id();
+    outlineColor = in.color();
+    fillColor = in.color();
+    uint8_t flags = in.u8();
+    locked = (flags & 1) != 0;
+    visible = (flags & 2) != 0;
+    ready = (flags & 4) != 0;
+    thickness = in.i32();
+    lineType = in.i32();
+    editing = false;
+    reserveId();
+}
+
+void Shape::reserveId()
+{
+    if (id == 0)
+    {
+        // backward compatible for old config files
+        id = genId();
+    }
+    else
+    {
+        // ensure no duplicate ids.
+        // new generated ids will always be bigger than ones in files.
+        int last = idGenerator;
+        while (last < id && ! idGenerator.compare_exchange_weak(last, id)) {}
+    }
+}
+
 ostream &operator<<(ostream &o, const Shape &shape)
 {
-    FileStorage fs("ignore.xml", FileStorage::WRITE | FileStorage::MEMORY);
-    fs << shape.getType() << shape;
-    o << fs.releaseAndGetString().c_str();
+    JsonWriter out(o);
+    out.document(shape);
     return o;
 }
 
@@ -3,6 +3,7 @@
 
 #include "canvascv/colors.h"
 #include "canvascv/consts.h"
+#include "canvascv/utils.h"
 
 #include <opencv2/core/mat.hpp>
 #include <string>
@@ -16,6 +17,9 @@ namespace canvascv
 
 class Handle;
 class Canvas;
+class BinaryWriter;
+class BinaryReader;
+class JsonWriter;
 
 /**
  * @brief The Shape class hierarchy is for geomertric user interaction.
@@ -42,6 +46,12 @@ public:
     /// virtual destructor
     virtual ~Shape();
 
+    /// shapes are allocated from the ShapePool
+    static void *operator new(size_t size);
+
+    /// return the memory of a shape to the ShapePool
+    static void operator delete(void *p, size_t size);
+
     /**
      * @brief The Event enum will let you know what just happended to the shape
      * 
@@ -121,6 +131,35 @@ public:
 
     virtual void translate(const cv::Point &offset) = 0;
 
+    /**
+     * @brief getBoundingRect
+     *
+     * Return a rect which contains all the pixels draw() may touch (including sub shapes).
+     * Derived shapes should override this. The default covers the whole plane, so
+     * unknown shapes are always considered as drawn everywhere.
+     * @return axis aligned bounding rect in canvas coordinates
+     */
+    virtual cv::Rect getBoundingRect() const;
+
+    /**
+     * @brief getBounds
+     *
+     * A cached getBoundingRect(), which is recomputed only after the shape (or any of
+     * its sub shapes) changed. Prefer it wherever the bounds are queried often.
+     * @return axis aligned bounding rect in canvas coordinates
+     */
+    const cv::Rect &getBounds() const;
+
+    /**
+     * @brief getVersion
+     *
+     * Incremented whenever this shape or any of its sub shapes changes (moved handles,
+     * translate(), new properties), so derived shapes can cache the geometry they derive
+     * from their handles and recompute it only when the version changed.
+     * @return the current version of the shape
+     */
+    unsigned getVersion() const;
+
     bool isReady() const;
 
     /// return a unique id for this shape
@@ -130,6 +169,22 @@ protected:
     virtual void writeInternals(cv::FileStorage& fs) const = 0;
     virtual void readInternals(const cv::FileNode& node) = 0;
 
+    /**
+     * @brief the binary counterparts of writeInternals() and readInternals()
+     *
+     * They hold the same fields, in the same order, using a BinaryWriter and a BinaryReader.
+     * A shape which adds fields to writeInternals() must add them here too.
+     */
+    virtual void writeBinaryInternals(BinaryWriter &out) const;
+    virtual void readBinaryInternals(BinaryReader &in);
+
+    /**
+     * @brief the JsonWriter counterpart of writeInternals(), with the same keys
+     *
+     * A shape which adds fields to writeInternals() must add them here too.
+     */
+    virtual void writeJsonInternals(JsonWriter &out) const;
+
     /**
      * @brief mousePressed
      * 
@@ -193,12 +248,27 @@ protected:
     /// helper method for non compund shapes to draw their members
     void drawHelper(cv::Mat &canvas, Shape *other);
 
+    /// true if the shape can't touch the pixels being drawn on canvas, so draw() can be skipped
+    bool isCulled(const cv::Mat &canvas) const;
+
     const std::string &getStatusMsg() const;
     virtual const std::string &getCreateStatusMsg() const = 0;
     virtual const std::string &getEditStatusMsg() const = 0;
 
     void setCanvas(Canvas &value);
 
+    /// let the Canvas know this shape (or the shape it is part of) needs redrawing
+    void setDirty();
+
+    /// mark 'child' as an internal part of this shape
+    void adopt(Shape &child);
+
+    /// let the Canvas find a new sub shape (and its sub shapes) by id
+    void indexSubShape(const std::shared_ptr<Shape> &child);
+
+    /// let the Canvas forget a sub shape (and its sub shapes) which is being removed
+    void unindexSubShape(Shape &child);
+
     void setDeleted();
 
     bool isDeleted();
@@ -219,12 +289,20 @@ private:
     friend void read(const cv::FileNode& node, Canvas& x, const Canvas&);
     friend class Canvas;
     friend class CompoundShape;
+    friend class ShapeSlotMap;
+    friend class BinaryWriter;
+    friend class BinaryReader;
+    friend class JsonWriter;
+    friend class ShapeStore;
 
     /// called when events happen
     void broadcastEvent(Event event);
 
     int genId();
 
+    /// keep a read id unique (ids from old files may be 0)
+    void reserveId();
+
     friend void write(cv::FileStorage& fs, const std::string&, const Shape& x);
     friend void read(const cv::FileNode& node, Shape*& x, const Shape* default_value);
 
@@ -234,13 +312,34 @@ private:
     std::list<CBPerShape> cbs;
     bool deleted;
     bool ready;
+    Shape *parent;
+
+    void updateDrawnBounds();
+
+    /// the Canvas of the top level shape this shape is part of (may be null)
+    Canvas *getRootCanvas() const;
+
+    /// append the direct sub shapes of this shape to 'result'
+    virtual void getSubShapes(std::list<std::shared_ptr<Shape>> &result) const;
+
+    // maintained by the Canvas for incremental redraw
+    bool damaged;
+    cv::Rect drawnBounds;
+
+    // see getVersion() and getBounds()
+    unsigned version;
+    mutable unsigned boundsVersion;
+    mutable cv::Rect bounds;
+
+    // the slot of a top level shape in the ShapeSlotMap of its Canvas
+    size_t slot;
 };
 
 // These write and read functions must be defined for the serialization in cv::FileStorage to work
 void write(cv::FileStorage& fs, const std::string&, const Shape& x);
 void read(const cv::FileNode& node, Shape*& x, const Shape* default_value);
 
-// Will write the xml to memory and output it's std::string
+// Will stream the shape as json (see JsonWriter)
 std::ostream & operator<<(std::ostream& o, const Shape &shape);
 
 }
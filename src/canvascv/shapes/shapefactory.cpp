@@ -14,6 +14,11 @@ Shape *ShapeFactory::newShape(std::string type, const cv::Point &pos)
     return shape;
 }
 
+bool ShapeFactory::hasShape(const string &type)
+{
+    return allocators && allocators->find(type) != allocators->end();
+}
+
 void ShapeFactory::addShape(std::string name, ShapeFactory::Allocator a)
 {
     if (! allocators)
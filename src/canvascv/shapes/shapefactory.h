@@ -6,6 +6,7 @@
 #include <functional>
 
 #include "canvascv/themes/themerepository.h"
+#include "shapepool.h"
 
 namespace canvascv
 {
@@ -19,6 +20,7 @@ class Shape;
  * @brief The ShapeFactory class
  * 
  * Holds shape creation methods. Don't use directly. Use Canvas::createShape() instead.
+ * The shapes are allocated from the ShapePool.
  * @sa Canvas::createShape()
  */
 class ShapeFactory
@@ -26,6 +28,9 @@ class ShapeFactory
 public:
     /// create a shape by type name at a certain initial pos (don't use directly. Use Canvas::createShape() instead).
     static Shape *newShape(std::string type, const cv::Point &pos);
+
+    /// true if newShape() can create shapes of this type name
+    static bool hasShape(const std::string &type);
 protected:
     typedef std::function<Shape*(const cv::Point &)> Allocator;
     static void addShape(std::string name, Allocator a);
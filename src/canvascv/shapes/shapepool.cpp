@@ -0,0 +1,313 @@
+#include "shapepool.h"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+using namespace std;
+
+namespace canvascv
+{
+
+// sizes are rounded up to multiples of GRANULARITY, and larger objects go to the heap
+static const size_t GRANULARITY = 16;
+static const size_t MAX_POOLED_SIZE = 1024;
+static const size_t SIZE_CLASSES = MAX_POOLED_SIZE / GRANULARITY;
+static const size_t OBJECTS_PER_CHUNK = 64;
+// objects moved at once between the free lists of a thread and the shared ones
+static const size_t BATCH_SIZE = 32;
+
+namespace
+{
+
+struct FreeNode
+{
+    FreeNode *next;
+};
+
+/// a counter written only by its thread, and read by getStats() from any thread
+struct Counter
+{
+    atomic<int64_t> value;
+
+    void add(int64_t amount)
+    {
+        value.store(value.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
+
+    int64_t get() const
+    {
+        return value.load(memory_order_relaxed);
+    }
+};
+
+struct LocalClass
+{
+    FreeNode *freeList; ///< memory freed into the pool by this thread
+    size_t freeCount;
+    char *chunkPos;     ///< memory never used yet
+    char *chunkEnd;
+};
+
+// trivially destructible, so it can still be used (as closed) while the thread exits
+struct ThreadCache
+{
+    LocalClass classes[SIZE_CLASSES];
+    Counter allocations;
+    Counter deallocations;
+    Counter reused;
+    Counter bytesInUse;     // may be negative when other threads allocated the memory
+    Counter bytesReserved;
+    ThreadCache *next;
+    bool registered;
+    bool closed;            // the thread is exiting and gave its memory back
+};
+
+struct SharedClass
+{
+    FreeNode *freeList;
+};
+
+struct Pools
+{
+    mutex lock;
+    SharedClass classes[SIZE_CLASSES];
+    ThreadCache *caches;            // of the live threads
+    ShapePool::Stats retired;       // of the exited threads, and of the exiting ones
+};
+
+/// gives the memory of the thread cache back to the shared lists when the thread exits
+struct CacheCloser
+{
+    CacheCloser() : active(false) {}
+    ~CacheCloser();
+
+    bool active;
+};
+
+}
+
+static Pools &getPools()
+{
+    // never deleted, so shapes destroyed at exit can still be freed
+    static Pools *pools = new Pools();
+    return *pools;
+}
+
+static thread_local ThreadCache threadCache;
+static thread_local CacheCloser cacheCloser;
+
+static ThreadCache &getCache()
+{
+    ThreadCache &cache = threadCache;
+    if (! cache.registered)
+    {
+        cache.registered = true;
+        cacheCloser.active = true;
+        Pools &pools = getPools();
+        lock_guard<mutex> guard(pools.lock);
+        cache.next = pools.caches;
+        pools.caches = &cache;
+    }
+    return cache;
+}
+
+CacheCloser::~CacheCloser()
+{
+    if (! active) return;
+    ThreadCache &cache = threadCache;
+    Pools &pools = getPools();
+    lock_guard<mutex> guard(pools.lock);
+    for (size_t i = 0; i < SIZE_CLASSES; ++i)
+    {
+        LocalClass &local = cache.classes[i];
+        SharedClass &shared = pools.classes[i];
+        while (local.freeList)
+        {
+            FreeNode *node = local.freeList;
+            local.freeList = node->next;
+            node->next = shared.freeList;
+            shared.freeList = node;
+        }
+        local.freeCount = 0;
+        // the rest of the chunk stays reserved, and unused
+        local.chunkPos = local.chunkEnd = nullptr;
+    }
+    for (ThreadCache **i = &pools.caches; *i; i = &(*i)->next)
+    {
+        if (*i == &cache)
+        {
+            *i = cache.next;
+            break;
+        }
+    }
+    pools.retired.allocations += cache.allocations.get();
+    pools.retired.deallocations += cache.deallocations.get();
+    pools.retired.reused += cache.reused.get();
+    pools.retired.bytesInUse += cache.bytesInUse.get();
+    pools.retired.bytesReserved += cache.bytesReserved.get();
+    cache.closed = true;
+}
+
+// for a closed cache: the shared lists, or the heap
+static void *allocateShared(size_t index)
+{
+    size_t rounded = (index + 1) * GRANULARITY;
+    Pools &pools = getPools();
+    {
+        lock_guard<mutex> guard(pools.lock);
+        ++pools.retired.allocations;
+        pools.retired.bytesInUse += rounded;
+        SharedClass &shared = pools.classes[index];
+        if (shared.freeList)
+        {
+            FreeNode *node = shared.freeList;
+            shared.freeList = node->next;
+            ++pools.retired.reused;
+            return node;
+        }
+        pools.retired.bytesReserved += rounded;
+    }
+    return ::operator new(rounded);
+}
+
+void *ShapePool::allocate(size_t size)
+{
+    if (size == 0) size = 1;
+    ThreadCache &cache = getCache();
+    if (size > MAX_POOLED_SIZE)
+    {
+        void *p = ::operator new(size);
+        if (cache.closed)
+        {
+            Pools &pools = getPools();
+            lock_guard<mutex> guard(pools.lock);
+            ++pools.retired.allocations;
+            pools.retired.bytesInUse += size;
+            pools.retired.bytesReserved += size;
+            return p;
+        }
+        cache.allocations.add(1);
+        cache.bytesInUse.add(size);
+        cache.bytesReserved.add(size);
+        return p;
+    }
+
+    size_t index = (size - 1) / GRANULARITY;
+    if (cache.closed) return allocateShared(index);
+
+    size_t rounded = (index + 1) * GRANULARITY;
+    LocalClass &local = cache.classes[index];
+    cache.allocations.add(1);
+    cache.bytesInUse.add(rounded);
+    if (! local.freeList)
+    {   // take a batch of the memory freed by other threads
+        Pools &pools = getPools();
+        lock_guard<mutex> guard(pools.lock);
+        SharedClass &shared = pools.classes[index];
+        for (size_t i = 0; i < BATCH_SIZE && shared.freeList; ++i)
+        {
+            FreeNode *node = shared.freeList;
+            shared.freeList = node->next;
+            node->next = local.freeList;
+            local.freeList = node;
+            ++local.freeCount;
+        }
+    }
+    if (local.freeList)
+    {
+        FreeNode *node = local.freeList;
+        local.freeList = node->next;
+        --local.freeCount;
+        cache.reused.add(1);
+        return node;
+    }
+    if (local.chunkPos == local.chunkEnd)
+    {
+        size_t chunkSize = rounded * OBJECTS_PER_CHUNK;
+        local.chunkPos = static_cast<char*>(::operator new(chunkSize));
+        local.chunkEnd = local.chunkPos + chunkSize;
+        cache.bytesReserved.add(chunkSize);
+    }
+    void *p = local.chunkPos;
+    local.chunkPos += rounded;
+    return p;
+}
+
+void ShapePool::deallocate(void *p, size_t size)
+{
+    if (! p) return;
+    if (size == 0) size = 1;
+    ThreadCache &cache = getCache();
+    if (size > MAX_POOLED_SIZE)
+    {
+        ::operator delete(p);
+        if (cache.closed)
+        {
+            Pools &pools = getPools();
+            lock_guard<mutex> guard(pools.lock);
+            ++pools.retired.deallocations;
+            pools.retired.bytesInUse -= size;
+            pools.retired.bytesReserved -= size;
+            return;
+        }
+        cache.deallocations.add(1);
+        cache.bytesInUse.add(-(int64_t)size);
+        cache.bytesReserved.add(-(int64_t)size);
+        return;
+    }
+
+    size_t index = (size - 1) / GRANULARITY;
+    size_t rounded = (index + 1) * GRANULARITY;
+    FreeNode *node = static_cast<FreeNode*>(p);
+    if (cache.closed)
+    {
+        Pools &pools = getPools();
+        lock_guard<mutex> guard(pools.lock);
+        SharedClass &shared = pools.classes[index];
+        node->next = shared.freeList;
+        shared.freeList = node;
+        ++pools.retired.deallocations;
+        pools.retired.bytesInUse -= rounded;
+        return;
+    }
+
+    LocalClass &local = cache.classes[index];
+    node->next = local.freeList;
+    local.freeList = node;
+    ++local.freeCount;
+    cache.deallocations.add(1);
+    cache.bytesInUse.add(-(int64_t)rounded);
+    if (local.freeCount > BATCH_SIZE * 2)
+    {   // let the other threads use what this thread doesn't need
+        Pools &pools = getPools();
+        lock_guard<mutex> guard(pools.lock);
+        SharedClass &shared = pools.classes[index];
+        for (size_t i = 0; i < BATCH_SIZE; ++i)
+        {
+            FreeNode *moved = local.freeList;
+            local.freeList = moved->next;
+            --local.freeCount;
+            moved->next = shared.freeList;
+            shared.freeList = moved;
+        }
+    }
+}
+
+ShapePool::Stats ShapePool::getStats()
+{
+    Pools &pools = getPools();
+    lock_guard<mutex> guard(pools.lock);
+    Stats stats = pools.retired;
+    for (ThreadCache *cache = pools.caches; cache; cache = cache->next)
+    {
+        stats.allocations += cache->allocations.get();
+        stats.deallocations += cache->deallocations.get();
+        stats.reused += cache->reused.get();
+        stats.bytesInUse += cache->bytesInUse.get();
+        stats.bytesReserved += cache->bytesReserved.get();
+    }
+    return stats;
+}
+
+}
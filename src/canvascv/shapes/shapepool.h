@@ -0,0 +1,91 @@
+#ifndef SHAPEPOOL_H
+#define SHAPEPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace canvascv
+{
+
+/**
+ * @brief The ShapePool class
+ *
+ * The memory of all the shapes (and their sub shapes, like the 9 Handles of a Rectangle)
+ * comes from here. It keeps a free list per size class, carved from large chunks, so
+ * creating and deleting shapes every frame reuses the same memory instead of going to
+ * the heap for every object.
+ *
+ * - Shape::operator new and Shape::operator delete use it, so every Shape is pooled.
+ * - Every thread has its own free lists, and exchanges memory with the shared ones in
+ *   batches, so threads creating shapes together (like Canvas::readShapesFromFile()) don't
+ *   wait for each other.
+ * - share() puts the shared_ptr control block in the pool too.
+ * - Memory freed into the pool is kept for the next shapes, and isn't returned to the heap.
+ */
+class ShapePool
+{
+public:
+    /// the allocation counters of the pool
+    struct Stats
+    {
+        uint64_t allocations;   ///< shapes and control blocks allocated
+        uint64_t deallocations; ///< shapes and control blocks freed
+        uint64_t reused;        ///< allocations served by memory freed before
+        size_t bytesInUse;      ///< allocated and not freed yet
+        size_t bytesReserved;   ///< taken from the heap (in use or free in the pool)
+    };
+
+    /// a standard allocator using the pool, for the shared_ptr control blocks
+    template <class T>
+    class Allocator
+    {
+    public:
+        typedef T value_type;
+
+        Allocator() {}
+
+        template <class U>
+        Allocator(const Allocator<U> &) {}
+
+        T *allocate(size_t n)
+        {
+            return static_cast<T*>(ShapePool::allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T *p, size_t n)
+        {
+            ShapePool::deallocate(p, n * sizeof(T));
+        }
+
+        template <class U>
+        bool operator==(const Allocator<U> &) const
+        {
+            return true;
+        }
+
+        template <class U>
+        bool operator!=(const Allocator<U> &) const
+        {
+            return false;
+        }
+    };
+
+    static void *allocate(size_t size);
+
+    /// size must be the size given to allocate()
+    static void deallocate(void *p, size_t size);
+
+    static Stats getStats();
+
+    /// take ownership of a new shape, with the control block allocated from the pool
+    template <class T>
+    static std::shared_ptr<T> share(T *shape)
+    {
+        return std::shared_ptr<T>(shape, std::default_delete<T>(), Allocator<T>());
+    }
+};
+
+}
+
+#endif // SHAPEPOOL_H
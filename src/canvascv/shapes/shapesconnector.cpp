@@ -1,5 +1,8 @@
 #include "shapesconnector.h"
+#include "binaryarchive.h"
+#include "jsonwriter.h"
 #include "canvascv/canvas.h"
+#include "canvascv/painter.h"
 
 #include <iterator>
 
@@ -33,8 +36,8 @@ void ShapesConnector::draw(Mat &canvas)
     {
         if ( i%space==0 )
         {
-            circle(canvas, lineIter.pos(), thickness, fillColor, -1, lineType);
-            circle(canvas, lineIter.pos(), thickness, outlineColor, 1, lineType);
+            Painter::circle(canvas, lineIter.pos(), thickness, fillColor, -1, lineType);
+            Painter::circle(canvas, lineIter.pos(), thickness, outlineColor, 1, lineType);
         }
     }
     CompoundShape::draw(canvas);
@@ -117,6 +120,13 @@ list<Handle *> ShapesConnector::getConnectionTargets()
     return  list<Handle *>({center});
 }
 
+Rect ShapesConnector::getBoundingRect() const
+{
+    // the dotted line is made of circles with a 'thickness' radius
+    return rectUnion(CompoundShape::getBoundingRect(),
+                     lineBoundingRect(getTail(), getHead(), thickness * 2 + 2));
+}
+
 const char *ShapesConnector::getType() const
 {
     return type;
@@ -186,6 +196,8 @@ void ShapesConnector::disconnectHead()
 
 void ShapesConnector::reconnect()
 {
+   if (! canvas) return;
+
    if (tailShape && tailHandle)
    {
        shared_ptr<Shape> pShape = canvas->getShape(tailShape);
@@ -271,6 +283,16 @@ void ShapesConnector::writeInternals(FileStorage &fs) const
     fs << "space" << space;
 }
 
+void ShapesConnector::writeJsonInternals(JsonWriter &out) const
+{
+    Line::writeJsonInternals(out);
+    out.field("tailShape", tailShape);
+    out.field("tailHandle", tailHandle);
+    out.field("headShape", headShape);
+    out.field("headHandle", headHandle);
+    out.field("space", space);
+}
+
 void ShapesConnector::readInternals(const FileNode &node)
 {
     Line::readInternals(node);
@@ -281,9 +303,29 @@ void ShapesConnector::readInternals(const FileNode &node)
     node["space"] >> space;
 }
 
+void ShapesConnector::writeBinaryInternals(BinaryWriter &out) const
+{
+    Line::writeBinaryInternals(out);
+    out.svarint(tailShape);
+    out.svarint(tailHandle);
+    out.svarint(headShape);
+    out.svarint(headHandle);
+    out.svarint(space);
+}
+
+void ShapesConnector::readBinaryInternals(BinaryReader &in)
+{
+    Line::readBinaryInternals(in);
+    tailShape = in.i32();
+    tailHandle = in.i32();
+    headShape = in.i32();
+    headHandle = in.i32();
+    space = in.i32();
+}
+
 Shape *ShapesConnector::getShapeFromCanvas(int id)
 {
-   if (id == 0)
+   if (id == 0 || ! canvas)
    {
        return nullptr;
    }
@@ -303,6 +345,8 @@ bool ShapesConnector::connectToEndPoint(Shape &shape, Handle &handle, Handle &en
 
 void ShapesConnector::DisconnectEndPoint(int handleId, Handle &endPoint)
 {
+    if (! canvas) return;
+
     shared_ptr<Shape> pHandle = canvas->getShape(handleId);
     if (pHandle.get())
     {
@@ -336,7 +380,7 @@ Handle::CBID ShapesConnector::registerConnectCB(const int &shapeId, Handle *hand
 {
     return handle->addPosChangedCB([this, &shapeId](const Point &pos)
     {
-        if (shapeId == 0)
+        if (shapeId == 0 && canvas)
         {
             for (auto &targetHandle : dragTargetHandles)
             {
@@ -61,6 +61,8 @@ public:
 
     virtual std::list<Handle *> getConnectionTargets();
 
+    virtual cv::Rect getBoundingRect() const;
+
     virtual const char *getType() const;
 
     static const char * type;
@@ -82,6 +84,9 @@ protected:
 
     virtual void writeInternals(cv::FileStorage &fs) const;
     virtual void readInternals(const cv::FileNode &node);
+    virtual void writeJsonInternals(JsonWriter &out) const;
+    virtual void writeBinaryInternals(BinaryWriter &out) const;
+    virtual void readBinaryInternals(BinaryReader &in);
 
 
     virtual void reloadPointers(const std::list<Shape*> &lst, std::list<Shape*>::const_iterator &i)
@@ -1,6 +1,9 @@
 #include "textbox.h"
+#include "binaryarchive.h"
+#include "jsonwriter.h"
 #include "canvascv/colors.h"
 #include "canvascv/canvas.h"
+#include "canvascv/painter.h"
 
 #include <opencv2/imgproc.hpp>
 
@@ -21,7 +24,8 @@ TextBox::TextBox(const Point &pos) :
     fontThickness(Consts::DEFAULT_FONT_THICKNESS),
     fontColor(Consts::DEFAULT_FONT_COLOR)
 {
-    topLeft.reset(ShapeFactoryT<Handle>::newShape(pos));
+    topLeft = ShapePool::share(ShapeFactoryT<Handle>::newShape(pos));
+    adopt(*topLeft);
     topLeft->setLocked(true);
     recalcRect();
     registerCBs();
@@ -40,10 +44,10 @@ void TextBox::draw(Mat &canvas)
             rectSelected.y -= 2;
             rectSelected.width += 4;
             rectSelected.height += 4;
-            rectangle(canvas, rectSelected, fillColor, thickness);
+            Painter::rectangle(canvas, rectSelected, fillColor, thickness);
         }
-        rectangle(canvas, rect, outlineColor, -1);
-        putText(canvas, text, Point(rect.tl().x,rect.tl().y+baseline*2), fontFace, fontScale,
+        Painter::rectangle(canvas, rect, outlineColor, -1);
+        Painter::putText(canvas, text, Point(rect.tl().x,rect.tl().y+baseline*2), fontFace, fontScale,
                 fontColor, fontThickness, LINE_AA);
         drawHelper(canvas, topLeft.get());
     }
@@ -170,7 +174,7 @@ void TextBox::setFontColor(const cv::Scalar &value)
 {
     fontColor = value;
     fontColor[3] = 255; // shape colors are opaque
-    if (canvas) canvas->setDirty();
+    setDirty();
 }
 
 int TextBox::getFontThickness() const
@@ -181,7 +185,7 @@ int TextBox::getFontThickness() const
 void TextBox::setFontThickness(int value)
 {
     fontThickness = value;
-    if (canvas) canvas->setDirty();
+    setDirty();
 }
 
 void TextBox::writeInternals(FileStorage &fs) const
@@ -195,13 +199,25 @@ void TextBox::writeInternals(FileStorage &fs) const
     fs << "fontColor" << fontColor;
 }
 
+void TextBox::writeJsonInternals(JsonWriter &out) const
+{
+    Shape::writeJsonInternals(out);
+    out.field("text", text);
+    out.key("topLeft");
+    out.shape(*topLeft);
+    out.field("fontFace", fontFace);
+    out.field("fontScale", fontScale);
+    out.field("fontThickness", fontThickness);
+    out.field("fontColor", fontColor);
+}
+
 void TextBox::readInternals(const FileNode &node)
 {
     Shape::readInternals(node);
     node["text"] >> text;
     Shape *shape = 0;
     node["topLeft"] >> shape;
-    topLeft.reset(dynamic_cast<Handle*>(shape));
+    setReadTopLeft(dynamic_cast<Handle*>(shape));
     node["fontFace"] >> fontFace;
     node["fontScale"] >> fontScale;
     node["fontThickness"] >> fontThickness;
@@ -210,6 +226,47 @@ void TextBox::readInternals(const FileNode &node)
     registerCBs();
 }
 
+void TextBox::writeBinaryInternals(BinaryWriter &out) const
+{
+    Shape::writeBinaryInternals(out);
+    out.str(text);
+    out.shape(*topLeft);
+    out.svarint(fontFace);
+    out.f64(fontScale);
+    out.svarint(fontThickness);
+    out.color(fontColor);
+}
+
+void TextBox::readBinaryInternals(BinaryReader &in)
+{
+    Shape::readBinaryInternals(in);
+    text = in.str();
+    Shape *shape = in.shape();
+    Handle *handle = dynamic_cast<Handle*>(shape);
+    if (! handle)
+    {
+        delete shape;
+        in.fail();
+        return;
+    }
+    setReadTopLeft(handle);
+    fontFace = in.i32();
+    fontScale = in.f64();
+    fontThickness = in.i32();
+    fontColor = in.color();
+    if (! in.ok()) return;
+    recalcRect();
+    registerCBs();
+}
+
+void TextBox::setReadTopLeft(Handle *handle)
+{
+    unindexSubShape(*topLeft);
+    topLeft = ShapePool::share(handle);
+    adopt(*topLeft);
+    indexSubShape(topLeft);
+}
+
 void TextBox::registerCBs()
 {
     topLeft->addPosChangedCB([this](const Point &)
@@ -232,6 +289,20 @@ shared_ptr<Shape> TextBox::getShape(int id)
    return nullptr;
 }
 
+void TextBox::getSubShapes(list<shared_ptr<Shape>> &result) const
+{
+    result.push_back(topLeft);
+}
+
+Rect TextBox::getBoundingRect() const
+{
+    // putText() may go above 'rect' for fonts with a small baseline
+    int textTop = rect.y + 4 * baseline - rect.height;
+    Rect textRect(rect.x, min(rect.y, textTop), rect.width, rect.br().y - min(rect.y, textTop));
+    return rectUnion(padRect(textRect, thickness + fontThickness + 3),
+                     topLeft->getBoundingRect());
+}
+
 const char *TextBox::getType() const
 {
     return type;
@@ -246,13 +317,13 @@ void TextBox::setText(const string &value)
 {
     text = value;
     recalcRect();
-    if (canvas) canvas->setDirty();
+    setDirty();
 }
 
 void TextBox::setTL(const Point &value)
 {
     topLeft->setPos(value);
-    if (canvas) canvas->setDirty();
+    setDirty();
 }
 
 int TextBox::getFontFace() const
@@ -264,7 +335,7 @@ void TextBox::setFontFace(int value)
 {
     fontFace = value;
     recalcRect();
-    if (canvas) canvas->setDirty();
+    setDirty();
 }
 
 double TextBox::getFontScale() const
@@ -276,7 +347,7 @@ void TextBox::setFontScale(double value)
 {
     fontScale = value;
     recalcRect();
-    if (canvas) canvas->setDirty();
+    setDirty();
 }
 
 void TextBox::translate(const Point &offset)
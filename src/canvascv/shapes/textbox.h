@@ -62,6 +62,8 @@ public:
 
     virtual void translate(const cv::Point &offset);
 
+    virtual cv::Rect getBoundingRect() const;
+
     virtual const char *getType() const;
 
     static const char * type;
@@ -74,6 +76,9 @@ protected:
 
     virtual void writeInternals(cv::FileStorage &fs) const;
     virtual void readInternals(const cv::FileNode &node);
+    virtual void writeJsonInternals(JsonWriter &out) const;
+    virtual void writeBinaryInternals(BinaryWriter &out) const;
+    virtual void readBinaryInternals(BinaryReader &in);
     void registerCBs();
 
     virtual void draw(cv::Mat &canvas);
@@ -87,8 +92,13 @@ protected:
     virtual const string &getCreateStatusMsg() const;
     virtual const string &getEditStatusMsg() const;
 private:
+    virtual void getSubShapes(std::list<std::shared_ptr<Shape>> &result) const;
+
     void recalcRect();
 
+    /// replace topLeft with a Handle which was just read
+    void setReadTopLeft(Handle *handle);
+
     std::string text;
     std::string prevText;
     int fontFace;
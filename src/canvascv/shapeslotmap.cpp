@@ -0,0 +1,137 @@
+#include "shapeslotmap.h"
+#include "shapes/shape.h"
+
+using namespace std;
+
+namespace canvascv
+{
+
+// the slots are squeezed when there are more empty slots than this and than shapes
+static const size_t MIN_EMPTY_SLOTS = 16;
+
+ShapeSlotMap::ShapeSlotMap()
+    : count(0)
+{
+}
+
+void ShapeSlotMap::push_back(const shared_ptr<Shape> &shape)
+{
+    shape->slot = slots.size();
+    slots.push_back(shape);
+    bounds.push_back(cv::Rect());
+    flags.push_back(0);
+    markStale(shape->slot);
+    ++count;
+}
+
+void ShapeSlotMap::erase(Shape *shape)
+{
+    size_t slot = shape->slot;
+    if (slot >= slots.size() || slots[slot].get() != shape) return;
+
+    slots[slot].reset();
+    bounds[slot] = cv::Rect();
+    flags[slot] = 0;
+    --count;
+    // keep back() a shape
+    while (slots.size() && ! slots.back())
+    {
+        slots.pop_back();
+        bounds.pop_back();
+        flags.pop_back();
+    }
+    size_t empty = slots.size() - count;
+    if (empty > MIN_EMPTY_SLOTS && empty > count)
+    {
+        compact();
+    }
+}
+
+void ShapeSlotMap::clear()
+{
+    slots.clear();
+    bounds.clear();
+    flags.clear();
+    staleSlots.clear();
+    count = 0;
+}
+
+size_t ShapeSlotMap::size() const
+{
+    return count;
+}
+
+bool ShapeSlotMap::empty() const
+{
+    return count == 0;
+}
+
+const shared_ptr<Shape> &ShapeSlotMap::back() const
+{
+    return slots.back();
+}
+
+void ShapeSlotMap::invalidate(Shape &shape)
+{
+    size_t slot = shape.slot;
+    if (slot >= slots.size() || slots[slot].get() != &shape) return;
+    markStale(slot);
+}
+
+void ShapeSlotMap::refresh()
+{
+    for (size_t slot : staleSlots)
+    {
+        // slots may be gone, or already refreshed through an earlier entry
+        if (slot >= slots.size() || ! (flags[slot] & STALE)) continue;
+        Shape *shape = slots[slot].get();
+        flags[slot] = shape && shape->getVisible() ? VISIBLE : 0;
+        bounds[slot] = shape ? shape->getBounds() : cv::Rect();
+    }
+    staleSlots.clear();
+}
+
+void ShapeSlotMap::markStale(size_t slot)
+{
+    if (flags[slot] & STALE) return;
+    flags[slot] |= STALE;
+    staleSlots.push_back(slot);
+}
+
+ShapeSlotMap::const_iterator ShapeSlotMap::begin() const
+{
+    return const_iterator(slots.data(), slots.data() + slots.size());
+}
+
+ShapeSlotMap::const_iterator ShapeSlotMap::end() const
+{
+    return const_iterator(slots.data() + slots.size(), slots.data() + slots.size());
+}
+
+void ShapeSlotMap::compact()
+{
+    size_t next = 0;
+    for (size_t slot = 0; slot < slots.size(); ++slot)
+    {
+        if (! slots[slot]) continue;
+        if (slot != next)
+        {
+            slots[next] = std::move(slots[slot]);
+            bounds[next] = bounds[slot];
+            flags[next] = flags[slot];
+        }
+        slots[next]->slot = next;
+        ++next;
+    }
+    slots.resize(next);
+    bounds.resize(next);
+    flags.resize(next);
+    // the stale slots moved too
+    staleSlots.clear();
+    for (size_t slot = 0; slot < next; ++slot)
+    {
+        if (flags[slot] & STALE) staleSlots.push_back(slot);
+    }
+}
+
+}
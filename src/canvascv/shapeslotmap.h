@@ -0,0 +1,154 @@
+#ifndef SHAPESLOTMAP_H
+#define SHAPESLOTMAP_H
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace canvascv
+{
+
+class Shape;
+
+/**
+ * @brief The ShapeSlotMap class
+ *
+ * The top level shapes of a Canvas, in z-order, in one contiguous array of slots.
+ *
+ * - Every shape remembers its slot, so erase() is O(1): it only empties the slot.
+ * - Empty slots are skipped by the iteration, and squeezed out once they are the majority.
+ * - The slots of the remaining shapes then change, but their order never does.
+ * - The bounds and the visibility of the shapes are kept in dense arrays parallel to the
+ *   slots, so culling scans them without touching the shapes themselves. Shapes which
+ *   changed are marked by invalidate() and re-read lazily by refresh(), like ShapeIndex does.
+ *
+ * Slots aren't stable handles, since compaction moves them. The shared_ptr of a shape, or its
+ * id (see Canvas::getShape()), is the handle to keep.
+ */
+class ShapeSlotMap
+{
+public:
+    /// iterates the shapes in z-order, skipping the empty slots
+    class const_iterator
+    {
+    public:
+        const_iterator(const std::shared_ptr<Shape> *posVal, const std::shared_ptr<Shape> *endVal)
+            : pos(posVal), end(endVal)
+        {
+            skipEmpty();
+        }
+
+        const std::shared_ptr<Shape> &operator*() const
+        {
+            return *pos;
+        }
+
+        const std::shared_ptr<Shape> *operator->() const
+        {
+            return pos;
+        }
+
+        const_iterator &operator++()
+        {
+            ++pos;
+            skipEmpty();
+            return *this;
+        }
+
+        bool operator==(const const_iterator &other) const
+        {
+            return pos == other.pos;
+        }
+
+        bool operator!=(const const_iterator &other) const
+        {
+            return pos != other.pos;
+        }
+
+    private:
+        void skipEmpty()
+        {
+            while (pos != end && ! *pos) ++pos;
+        }
+
+        const std::shared_ptr<Shape> *pos;
+        const std::shared_ptr<Shape> *end;
+    };
+
+    ShapeSlotMap();
+
+    /// add a shape on top of all the others
+    void push_back(const std::shared_ptr<Shape> &shape);
+
+    /// remove a shape in O(1) (ignored for shapes which aren't in the map)
+    void erase(Shape *shape);
+
+    void clear();
+
+    /// the amount of shapes (not slots)
+    size_t size() const;
+
+    bool empty() const;
+
+    /// the top most shape (the map must not be empty)
+    const std::shared_ptr<Shape> &back() const;
+
+    /// the bounds or the visibility of shape may have changed (ignored for shapes which aren't in the map)
+    void invalidate(Shape &shape);
+
+    /// re-read the bounds and the visibility of the invalidated shapes
+    void refresh();
+
+    /// the amount of slots, including the empty ones
+    size_t getSlotCount() const
+    {
+        return slots.size();
+    }
+
+    /// the shape of a slot (null for an empty slot)
+    const std::shared_ptr<Shape> &getShape(size_t slot) const
+    {
+        return slots[slot];
+    }
+
+    /// false for an empty slot or a hidden shape, as of the last refresh()
+    bool isVisible(size_t slot) const
+    {
+        return (flags[slot] & VISIBLE) != 0;
+    }
+
+    /// the bounds of the shape of a slot (see Shape::getBounds()), as of the last refresh()
+    const cv::Rect &getBounds(size_t slot) const
+    {
+        return bounds[slot];
+    }
+
+    const_iterator begin() const;
+
+    const_iterator end() const;
+
+private:
+    enum
+    {
+        VISIBLE = 1,
+        STALE = 2
+    };
+
+    /// squeeze out the empty slots
+    void compact();
+
+    void markStale(size_t slot);
+
+    std::vector<std::shared_ptr<Shape>> slots;
+    std::vector<cv::Rect> bounds;
+    std::vector<uint8_t> flags;
+    std::vector<size_t> staleSlots;
+    size_t count;
+};
+
+}
+
+#endif // SHAPESLOTMAP_H
@@ -0,0 +1,566 @@
+#include "shapestore.h"
+#include "shapes/binaryarchive.h"
+#include "shapes/shape.h"
+#include "shapes/shapepool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+const char *ShapeStore::FILE_EXTENSION = ".ccvs";
+
+// The file layout, little endian:
+// header:  tag, version, shape count, node count, entries offset, nodes offset, ids offset
+// records: a BinaryWriter encoding per shape
+// entries: per shape bounds (x, y, width, height), record offset, record size, drawing order
+// nodes:   per R-tree node bounds, first child, child count and a leaf flag. Leaves point at
+//          entries, other nodes at nodes, and the root is the last node
+// ids:     (id, entry) sorted by id
+static const char LAYOUT_TAG[4] = {'C', 'C', 'V', 'S'};
+static const size_t HEADER_SIZE = 40;
+static const size_t ENTRY_SIZE = 32;
+static const size_t NODE_SIZE = 24;
+static const size_t ID_SIZE = 8;
+static const uint32_t NODE_CAPACITY = 16;
+
+static void putU16(vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back((uint8_t)value);
+    out.push_back((uint8_t)(value >> 8));
+}
+
+static void putU32(vector<uint8_t> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out.push_back((uint8_t)(value >> (i * 8)));
+    }
+}
+
+static void putU64(vector<uint8_t> &out, uint64_t value)
+{
+    putU32(out, (uint32_t)value);
+    putU32(out, (uint32_t)(value >> 32));
+}
+
+static void putRect(vector<uint8_t> &out, const Rect &rect)
+{
+    putU32(out, (uint32_t)rect.x);
+    putU32(out, (uint32_t)rect.y);
+    putU32(out, (uint32_t)rect.width);
+    putU32(out, (uint32_t)rect.height);
+}
+
+static uint16_t getU16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t *p)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        value |= (uint32_t)p[i] << (i * 8);
+    }
+    return value;
+}
+
+static uint64_t getU64(const uint8_t *p)
+{
+    return getU32(p) | (uint64_t)getU32(p + 4) << 32;
+}
+
+static Rect getRect(const uint8_t *p)
+{
+    return Rect((int)getU32(p), (int)getU32(p + 4), (int)getU32(p + 8), (int)getU32(p + 12));
+}
+
+// inclusive, so shapes with empty bounds (like a single point) are found too
+static bool touches(const Rect &a, const Rect &b)
+{
+    return a.x <= b.x + b.width && b.x <= a.x + a.width &&
+            a.y <= b.y + b.height && b.y <= a.y + a.height;
+}
+
+static Rect unite(const Rect &a, const Rect &b)
+{
+    int x = min(a.x, b.x), y = min(a.y, b.y);
+    return Rect(x, y, max(a.x + a.width, b.x + b.width) - x, max(a.y + a.height, b.y + b.height) - y);
+}
+
+namespace
+{
+
+struct BuildItem
+{
+    Rect box;
+    uint32_t first;  // a shape, an entry or a node, by the level
+    uint32_t count;
+};
+
+}
+
+// Sort-Tile-Recursive: order the items so each NODE_CAPACITY consecutive items are a tile
+// of neighbours, the tiles being vertical slices cut by y
+static void tileSort(vector<BuildItem> &items)
+{
+    auto centerX = [](const BuildItem &item) { return 2 * (int64_t)item.box.x + item.box.width; };
+    auto centerY = [](const BuildItem &item) { return 2 * (int64_t)item.box.y + item.box.height; };
+    sort(items.begin(), items.end(), [&](const BuildItem &a, const BuildItem &b)
+    {
+        return centerX(a) < centerX(b);
+    });
+    size_t tiles = (items.size() + NODE_CAPACITY - 1) / NODE_CAPACITY;
+    size_t sliceSize = (size_t)ceil(sqrt((double)tiles)) * NODE_CAPACITY;
+    for (size_t start = 0; start < items.size(); start += sliceSize)
+    {
+        auto end = items.begin() + min(items.size(), start + sliceSize);
+        sort(items.begin() + start, end, [&](const BuildItem &a, const BuildItem &b)
+        {
+            return centerY(a) < centerY(b);
+        });
+    }
+}
+
+// group each NODE_CAPACITY consecutive items into a parent
+static vector<BuildItem> groupItems(const vector<BuildItem> &items)
+{
+    vector<BuildItem> parents;
+    for (size_t first = 0; first < items.size(); first += NODE_CAPACITY)
+    {
+        size_t end = min(items.size(), first + NODE_CAPACITY);
+        BuildItem parent = {items[first].box, (uint32_t)first, (uint32_t)(end - first)};
+        for (size_t i = first + 1; i < end; ++i)
+        {
+            parent.box = unite(parent.box, items[i].box);
+        }
+        parents.push_back(parent);
+    }
+    return parents;
+}
+
+class ShapeStore::MappedFile
+{
+public:
+    MappedFile()
+        : data(nullptr),
+          size(0)
+#ifdef _WIN32
+        , fileHandle(INVALID_HANDLE_VALUE),
+          mapping(nullptr)
+#endif
+    {
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+#else
+        if (data) munmap((void*)data, size);
+#endif
+    }
+
+    bool open(const string &filepath)
+    {
+#ifdef _WIN32
+        fileHandle = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (! GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) return false;
+        mapping = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (! mapping) return false;
+        data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)fileSize.QuadPart;
+#else
+        int fd = ::open(filepath.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                data = (const uint8_t*)p;
+                size = (size_t)st.st_size;
+            }
+        }
+        ::close(fd); // the mapping keeps the file
+#endif
+        return data != nullptr;
+    }
+
+    const uint8_t *data;
+    size_t size;
+
+private:
+#ifdef _WIN32
+    HANDLE fileHandle;
+    HANDLE mapping;
+#endif
+};
+
+bool ShapeStore::write(const string &filepath, const list<shared_ptr<Shape>> &shapes)
+{
+    ofstream out(filepath, ios::binary | ios::trunc);
+    if (! out) return false;
+    vector<uint8_t> buffer(HEADER_SIZE, 0);
+    out.write((const char*)buffer.data(), buffer.size());
+
+    // the records, in drawing order
+    vector<BuildItem> items;
+    vector<uint64_t> offsets;
+    vector<uint32_t> sizes;
+    vector<pair<int, uint32_t>> idOrder;
+    uint64_t offset = HEADER_SIZE;
+    for (auto &shape : shapes)
+    {
+        if (! shape->isReady()) continue;
+        BinaryWriter writer;
+        writer.shape(*shape);
+        buffer.clear();
+        writer.finish(buffer);
+        out.write((const char*)buffer.data(), buffer.size());
+
+        uint32_t order = (uint32_t)items.size();
+        items.push_back({shape->getBounds(), order, 1});
+        offsets.push_back(offset);
+        sizes.push_back((uint32_t)buffer.size());
+        idOrder.push_back(make_pair(shape->getId(), order));
+        offset += buffer.size();
+    }
+
+    // the entries are in the order of the leaves, so each leaf is a range of entries
+    tileSort(items);
+    uint64_t entriesOffset = offset;
+    vector<uint32_t> entryOf(items.size());
+    buffer.clear();
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        uint32_t order = items[i].first;
+        entryOf[order] = (uint32_t)i;
+        putRect(buffer, items[i].box);
+        putU64(buffer, offsets[order]);
+        putU32(buffer, sizes[order]);
+        putU32(buffer, order);
+    }
+    out.write((const char*)buffer.data(), buffer.size());
+
+    // the R-tree levels from the leaves up, each level placed after the one below it
+    uint64_t nodesOffset = entriesOffset + buffer.size();
+    buffer.clear();
+    uint32_t nodeCount = 0;
+    vector<BuildItem> level = groupItems(items);
+    bool leaves = true;
+    while (! level.empty())
+    {
+        if (level.size() > 1) tileSort(level);
+        uint32_t levelBase = nodeCount;
+        for (auto &node : level)
+        {
+            putRect(buffer, node.box);
+            putU32(buffer, node.first);
+            putU16(buffer, (uint16_t)node.count);
+            putU16(buffer, leaves ? 1 : 0);
+        }
+        nodeCount += (uint32_t)level.size();
+        if (level.size() == 1) break;
+
+        // the parents point at the nodes of this level
+        vector<BuildItem> parents = groupItems(level);
+        for (auto &parent : parents)
+        {
+            parent.first += levelBase;
+        }
+        level.swap(parents);
+        leaves = false;
+    }
+    out.write((const char*)buffer.data(), buffer.size());
+
+    uint64_t idsOffset = nodesOffset + buffer.size();
+    sort(idOrder.begin(), idOrder.end());
+    buffer.clear();
+    for (auto &id : idOrder)
+    {
+        putU32(buffer, (uint32_t)id.first);
+        putU32(buffer, entryOf[id.second]);
+    }
+    out.write((const char*)buffer.data(), buffer.size());
+
+    buffer.clear();
+    buffer.insert(buffer.end(), LAYOUT_TAG, LAYOUT_TAG + 4);
+    putU32(buffer, LAYOUT_VERSION);
+    putU32(buffer, (uint32_t)items.size());
+    putU32(buffer, nodeCount);
+    putU64(buffer, entriesOffset);
+    putU64(buffer, nodesOffset);
+    putU64(buffer, idsOffset);
+    out.seekp(0);
+    out.write((const char*)buffer.data(), buffer.size());
+    return (bool)out.flush();
+}
+
+ShapeStore::ShapeStore()
+    : count(0),
+      nodeCount(0),
+      records(nullptr),
+      entries(nullptr),
+      nodes(nullptr),
+      ids(nullptr),
+      recordsSize(0)
+{
+}
+
+ShapeStore::~ShapeStore()
+{
+}
+
+bool ShapeStore::open(const string &filepath)
+{
+    close();
+    unique_ptr<MappedFile> mapped(new MappedFile);
+    if (! mapped->open(filepath)) return false;
+
+    const uint8_t *data = mapped->data;
+    size_t size = mapped->size;
+    if (size < HEADER_SIZE || memcmp(data, LAYOUT_TAG, 4) != 0 ||
+            getU32(data + 4) != LAYOUT_VERSION)
+    {
+        return false;
+    }
+    uint32_t shapeCount = getU32(data + 8);
+    uint32_t nodesInFile = getU32(data + 12);
+    uint64_t entriesOffset = getU64(data + 16);
+    uint64_t nodesOffset = getU64(data + 24);
+    uint64_t idsOffset = getU64(data + 32);
+    if (entriesOffset < HEADER_SIZE ||
+            nodesOffset != entriesOffset + (uint64_t)shapeCount * ENTRY_SIZE ||
+            idsOffset != nodesOffset + (uint64_t)nodesInFile * NODE_SIZE ||
+            idsOffset + (uint64_t)shapeCount * ID_SIZE > size ||
+            (shapeCount == 0) != (nodesInFile == 0))
+    {
+        return false;
+    }
+
+    // children come before their parents, so walking the tree always ends
+    for (uint32_t i = 0; i < nodesInFile; ++i)
+    {
+        const uint8_t *node = data + nodesOffset + i * NODE_SIZE;
+        uint64_t end = (uint64_t)getU32(node + 16) + getU16(node + 20);
+        if (end > (getU16(node + 22) ? shapeCount : i)) return false;
+    }
+    for (uint32_t i = 0; i < shapeCount; ++i)
+    {
+        if (getU32(data + idsOffset + i * ID_SIZE + 4) >= shapeCount) return false;
+    }
+
+    file = move(mapped);
+    count = shapeCount;
+    nodeCount = nodesInFile;
+    records = data;
+    recordsSize = (size_t)entriesOffset;
+    entries = data + entriesOffset;
+    nodes = data + nodesOffset;
+    ids = data + idsOffset;
+    return true;
+}
+
+void ShapeStore::close()
+{
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        cache.clear();
+    }
+    file.reset();
+    count = nodeCount = 0;
+    records = entries = nodes = ids = nullptr;
+    recordsSize = 0;
+}
+
+bool ShapeStore::isOpen() const
+{
+    return file.get() != nullptr;
+}
+
+size_t ShapeStore::size() const
+{
+    return count;
+}
+
+Rect ShapeStore::getBounds() const
+{
+    return nodeCount ? getRect(nodes + (nodeCount - 1) * NODE_SIZE) : Rect();
+}
+
+void ShapeStore::getShapes(const Rect &area, list<shared_ptr<Shape>> &result)
+{
+    vector<uint32_t> found;
+    query(area, found);
+    toDrawingOrder(found);
+    for (uint32_t entry : found)
+    {
+        shared_ptr<Shape> shape = getEntryShape(entry, false);
+        if (shape) result.push_back(shape);
+    }
+}
+
+void ShapeStore::getShapes(const Point &pos, list<shared_ptr<Shape>> &result)
+{
+    vector<uint32_t> found;
+    query(Rect(pos, Size(0, 0)), found);
+    toDrawingOrder(found);
+    for (uint32_t entry : found)
+    {
+        shared_ptr<Shape> shape = getEntryShape(entry, false);
+        if (shape && shape->isAtPos(pos)) result.push_back(shape);
+    }
+}
+
+shared_ptr<Shape> ShapeStore::getShape(int id)
+{
+    // binary search of the id table
+    uint32_t low = 0, high = count;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        int middleId = (int)getU32(ids + middle * ID_SIZE);
+        if (middleId < id)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (low == count || (int)getU32(ids + low * ID_SIZE) != id) return nullptr;
+    return getEntryShape(getU32(ids + low * ID_SIZE + 4), false);
+}
+
+void ShapeStore::renderOn(Mat &dst, const vector<Rect> &areas)
+{
+    if (! count) return;
+
+    const Rect frame(Point(0, 0), dst.size());
+    vector<uint32_t> visible;
+    if (areas.empty())
+    {
+        query(frame, visible);
+    }
+    for (auto &area : areas)
+    {
+        query(area & frame, visible);
+    }
+    toDrawingOrder(visible);
+
+    for (uint32_t entry : visible)
+    {
+        shared_ptr<Shape> shape = getEntryShape(entry, true);
+        if (shape && shape->getVisible()) shape->draw(dst);
+    }
+
+    if (areas.empty())
+    {
+        // keep only what is on screen
+        lock_guard<mutex> lock(cacheMutex);
+        unordered_map<uint32_t, shared_ptr<Shape>> onScreen;
+        for (uint32_t entry : visible)
+        {
+            auto iter = cache.find(entry);
+            if (iter != cache.end()) onScreen.insert(*iter);
+        }
+        cache.swap(onScreen);
+    }
+}
+
+size_t ShapeStore::getCachedCount() const
+{
+    lock_guard<mutex> lock(cacheMutex);
+    return cache.size();
+}
+
+void ShapeStore::query(const Rect &area, vector<uint32_t> &result) const
+{
+    if (! nodeCount) return;
+    vector<uint32_t> stack(1, nodeCount - 1);
+    while (! stack.empty())
+    {
+        const uint8_t *node = nodes + stack.back() * NODE_SIZE;
+        stack.pop_back();
+        if (! touches(getRect(node), area)) continue;
+
+        uint32_t first = getU32(node + 16);
+        uint32_t end = first + getU16(node + 20);
+        if (getU16(node + 22))
+        {
+            for (uint32_t entry = first; entry < end; ++entry)
+            {
+                if (touches(getEntryBounds(entry), area)) result.push_back(entry);
+            }
+        }
+        else
+        {
+            for (uint32_t child = first; child < end; ++child)
+            {
+                stack.push_back(child);
+            }
+        }
+    }
+}
+
+void ShapeStore::toDrawingOrder(vector<uint32_t> &found) const
+{
+    auto order = [this](uint32_t entry) { return getU32(entries + entry * ENTRY_SIZE + 28); };
+    sort(found.begin(), found.end(), [&](uint32_t a, uint32_t b) { return order(a) < order(b); });
+    found.erase(unique(found.begin(), found.end()), found.end());
+}
+
+Rect ShapeStore::getEntryBounds(uint32_t entry) const
+{
+    return getRect(entries + entry * ENTRY_SIZE);
+}
+
+shared_ptr<Shape> ShapeStore::getEntryShape(uint32_t entry, bool keep)
+{
+    lock_guard<mutex> lock(cacheMutex);
+    auto iter = cache.find(entry);
+    if (iter != cache.end()) return iter->second;
+
+    const uint8_t *p = entries + entry * ENTRY_SIZE;
+    uint64_t offset = getU64(p + 16);
+    uint32_t size = getU32(p + 24);
+    if (offset < HEADER_SIZE || offset + size > recordsSize) return nullptr;
+
+    BinaryReader reader(records + offset, size);
+    Shape *shape = reader.shape();
+    if (! shape) return nullptr;
+    shared_ptr<Shape> result = ShapePool::share(shape);
+    if (keep) cache[entry] = result;
+    return result;
+}
+
+}
@@ -0,0 +1,113 @@
+#ifndef SHAPESTORE_H
+#define SHAPESTORE_H
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace canvascv
+{
+
+class Shape;
+
+/**
+ * @brief The ShapeStore class
+ *
+ * A read only scene file (".ccvs") for annotation sets too large to load into a Canvas.
+ * The file is memory mapped, and shapes are decoded only when they are drawn or queried,
+ * so opening it costs the same for any amount of shapes.
+ *
+ * - write() saves shapes in the layout: each shape encoded by a BinaryWriter, followed by
+ *   the bounds of the shapes, a packed R-tree over the bounds and an id table.
+ * - renderOn() draws the shapes touching the frame, in their original order, keeping the
+ *   decoded shapes of the last full frame for the next frames.
+ * - The query methods decode the shapes they return, and don't grow the cache.
+ *
+ * Attach it to a Canvas with Canvas::setShapeStore() to draw it under the Canvas shapes.
+ * Shapes returned by the store aren't on any Canvas, so changing them changes nothing
+ * in the file or on the screen.
+ */
+class ShapeStore
+{
+public:
+    /// the file extension of the store files
+    static const char *FILE_EXTENSION;
+
+    /// the version of the file layout written by write()
+    static const uint32_t LAYOUT_VERSION = 1;
+
+    /// write 'shapes' (the ready ones) into a store file
+    static bool write(const std::string &filepath, const std::list<std::shared_ptr<Shape>> &shapes);
+
+    ShapeStore();
+
+    ~ShapeStore();
+
+    /// map a file written by write(), false if it isn't a valid store file
+    bool open(const std::string &filepath);
+
+    /// unmap the file and drop the decoded shapes
+    void close();
+
+    bool isOpen() const;
+
+    /// the amount of shapes in the store
+    size_t size() const;
+
+    /// the union of the bounds of all the shapes
+    cv::Rect getBounds() const;
+
+    /// all the shapes whose bounds touch 'area', in drawing order
+    void getShapes(const cv::Rect &area, std::list<std::shared_ptr<Shape>> &result);
+
+    /// all the shapes at pos (see Shape::isAtPos()), in drawing order
+    void getShapes(const cv::Point &pos, std::list<std::shared_ptr<Shape>> &result);
+
+    /// the shape with this id, or null
+    std::shared_ptr<Shape> getShape(int id);
+
+    /// draw the shapes touching the areas of dst (all of it if 'areas' is empty)
+    void renderOn(cv::Mat &dst, const std::vector<cv::Rect> &areas = std::vector<cv::Rect>());
+
+    /// the amount of decoded shapes kept for drawing
+    size_t getCachedCount() const;
+
+private:
+    ShapeStore(const ShapeStore&) = delete;
+    ShapeStore &operator=(const ShapeStore&) = delete;
+
+    class MappedFile;
+
+    /// the entries whose bounds touch 'area', added to 'result'
+    void query(const cv::Rect &area, std::vector<uint32_t> &result) const;
+
+    /// sort by drawing order and drop duplicates
+    void toDrawingOrder(std::vector<uint32_t> &entries) const;
+
+    cv::Rect getEntryBounds(uint32_t entry) const;
+
+    /// the cached shape of an entry, or decode it (null if the record is invalid)
+    std::shared_ptr<Shape> getEntryShape(uint32_t entry, bool keep);
+
+    std::unique_ptr<MappedFile> file;
+    uint32_t count;
+    uint32_t nodeCount;
+    const uint8_t *records;
+    const uint8_t *entries;
+    const uint8_t *nodes;
+    const uint8_t *ids;
+    size_t recordsSize;
+
+    mutable std::mutex cacheMutex;
+    std::unordered_map<uint32_t, std::shared_ptr<Shape>> cache;
+};
+
+}
+
+#endif // SHAPESTORE_H
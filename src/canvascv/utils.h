@@ -1,6 +1,9 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <opencv2/core.hpp>
+
+#include <algorithm>
 #include <functional>
 #include <list>
 
@@ -59,6 +62,40 @@ private:
     std::list<CBType> cbs;
 };
 
+/// union of 2 rects, where an empty rect doesn't contribute anything
+inline cv::Rect rectUnion(const cv::Rect &a, const cv::Rect &b)
+{
+    if (a.width <= 0 || a.height <= 0) return b;
+    if (b.width <= 0 || b.height <= 0) return a;
+    int x1 = std::min(a.x, b.x);
+    int y1 = std::min(a.y, b.y);
+    int x2 = std::max(a.x + a.width, b.x + b.width);
+    int y2 = std::max(a.y + a.height, b.y + b.height);
+    return cv::Rect(x1, y1, x2 - x1, y2 - y1);
+}
+
+/// true if the 2 rects share at least one pixel
+inline bool rectsIntersect(const cv::Rect &a, const cv::Rect &b)
+{
+    return a.x < b.x + b.width && b.x < a.x + a.width &&
+            a.y < b.y + b.height && b.y < a.y + a.height &&
+            a.width > 0 && a.height > 0 && b.width > 0 && b.height > 0;
+}
+
+/// grow rect by 'pad' pixels in all directions
+inline cv::Rect padRect(const cv::Rect &rect, int pad)
+{
+    return cv::Rect(rect.x - pad, rect.y - pad, rect.width + pad * 2, rect.height + pad * 2);
+}
+
+/// bounding rect of the pixels touched by drawing a line of 'thickness' from p1 to p2
+inline cv::Rect lineBoundingRect(const cv::Point &p1, const cv::Point &p2, int thickness)
+{
+    cv::Rect rect(std::min(p1.x, p2.x), std::min(p1.y, p2.y),
+                  std::abs(p1.x - p2.x) + 1, std::abs(p1.y - p2.y) + 1);
+    return padRect(rect, thickness / 2 + 2); // +2 for LINE_AA
+}
+
 }
 
 #endif // UTILS_H
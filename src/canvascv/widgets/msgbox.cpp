@@ -3,12 +3,6 @@
 #include "button.h"
 #include "canvascv/canvas.h"
 
-#include <opencv2/highgui.hpp>
-
-#if ! OPENCV_HAS_WINDOW_GUI_NORMAL
-#define WINDOW_GUI_NORMAL 0
-#endif
-
 using namespace std;
 using namespace cv;
 
@@ -87,44 +81,6 @@ shared_ptr<MsgBox> MsgBox::create(Canvas &canvas, const string &msg, vector<stri
     return msgBox;
 }
 
-int MsgBox::createModal(const string &title, const string &msg, std::vector<string> buttonNames, Widget::CBUserSelection cbUserSelection)
-{
-    Canvas c(title, Size(1024, 768));
-    auto msgBox = create(c, msg, buttonNames, cbUserSelection);
-    msgBox->update();
-    c.setSize(msgBox->getRect().size());
-    msgBox->setLocation({0,0});
-    namedWindow(title, WINDOW_AUTOSIZE | WINDOW_GUI_NORMAL);
-    c.setMouseCallback();
-    int delay = 1000 / 25; // delay because of the polling
-    Mat out;
-    while(! msgBox->isRemoved())
-    {
-        c.redrawOn(out);
-        c.imshow(out);
-        c.waitKeyEx(delay);
-    }
-    destroyWindow(title);
-    return msgBox->getUserSelection();
-}
-
-int MsgBox::getUserSelection(bool blocking)
-{
-    if (blocking)
-    {
-        Canvas *c = (Canvas*) getLayout();
-        int delay = 1000 / 25; // delay because of the polling
-        Mat out;
-        while(! isRemoved())
-        {
-            c->redrawOn(out);
-            c->imshow(out);
-            c->waitKeyEx(delay);
-        }
-    }
-    return userSelection;
-}
-
 string MsgBox::getTextAt(int index) const
 {
     if (index >= 0 && index < size())
@@ -73,6 +73,7 @@ public:
      * @param cbUserSelection a callback to invoke with index of pressed button
      * @return return result of getUserSelection()
      * @sa getUserSelection(true)
+     * @note only in the canvascv library (it uses highgui)
      */
     static int createModal(const std::string &title,
                            const std::string &msg,
@@ -85,6 +86,7 @@ public:
      * get what the user pressed
      * @param blocking if true, block waiting on the MsgBox until a button is pressed
      * @return returns pressed button index or -1 if not pressed
+     * @note only in the canvascv library (it uses highgui). Without it use the cbUserSelection of create().
      */
     int getUserSelection(bool blocking = false);
 
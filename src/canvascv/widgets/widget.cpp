@@ -2,6 +2,8 @@
 #include "widgetfactory.h"
 #include "layout.h"
 #include "autolayout.h"
+#include "canvascv/blend.h"
+#include "canvascv/painter.h"
 #include "canvascv/themes/theme.h"
 #include "canvascv/themes/themerepository.h"
 
@@ -52,8 +54,12 @@ Widget::Widget(const Point &pos)
       isSelectable(false),
       layout(nullptr),
       state(LEAVE),
+      shownRelief(FLAT),
+      ownFG(false),
+      flatDirty(false),
       isDirty(false),
-      updateCalls(0)
+      updateCalls(0),
+      damaged(false)
 {
     outlineColor[3] = 255; // FG is always opaque
     selectColor[3] = 255; // select is opaque
@@ -106,7 +112,11 @@ void Widget::setFillColor(const Scalar &value)
 
 void Widget::setVisible(bool value)
 {
-    visible = value;
+    if (visible != value)
+    {
+        visible = value;
+        setDirty();
+    }
 }
 
 int Widget::getThickness() const
@@ -361,83 +371,75 @@ void Widget::mergeMats(Mat &roiSrc, Mat &roiDst)
 {
     assert(roiSrc.size() == roiDst.size());
     if (roiSrc.channels() == 3)
-    {
-        assert(roiDst.channels() == 4); // that case is not implemented yet
-        Vec3b *pSrcRow;
-        Vec4b *pDstRow;
-        for (int r = 0; r < roiDst.rows; ++r)
-        {
-            pSrcRow = roiSrc.ptr<Vec3b>(r);
-            pDstRow = roiDst.ptr<Vec4b>(r);
-            for (int c = 0; c < roiDst.cols; ++c)
-            {
-                pDstRow[c][0] = pSrcRow[c][0];
-                pDstRow[c][1] = pSrcRow[c][1];
-                pDstRow[c][2] = pSrcRow[c][2];
-                pDstRow[c][3] = 255; // opaque
-            }
-        }
-    }
-    else
     {
         if (roiDst.channels() == 4)
         {
-            Vec4b *pSrcRow;
-            Vec4b *pDstRow;
-            double alpha, beta;
-            for (int r = 0; r < roiDst.rows; ++r)
-            {
-                pSrcRow = roiSrc.ptr<Vec4b>(r);
-                pDstRow = roiDst.ptr<Vec4b>(r);
-                for (int c = 0; c < roiDst.cols; ++c)
-                {
-                    alpha = pSrcRow[c][3] / 255.;
-                    beta = 1. - alpha;
-                    pDstRow[c][0] = (uchar) pSrcRow[c][0]*alpha + pDstRow[c][0]*beta;
-                    pDstRow[c][1] = (uchar) pSrcRow[c][1]*alpha + pDstRow[c][1]*beta;
-                    pDstRow[c][2] = (uchar) pSrcRow[c][2]*alpha + pDstRow[c][2]*beta;
-                }
-            }
+            Blend::copyOpaque(roiSrc, roiDst);
         }
         else
         {
-            Vec4b *pSrcRow;
-            Vec3b *pDstRow;
-            double alpha, beta;
-            for (int r = 0; r < roiDst.rows; ++r)
-            {
-                pSrcRow = roiSrc.ptr<Vec4b>(r);
-                pDstRow = roiDst.ptr<Vec3b>(r);
-                for (int c = 0; c < roiDst.cols; ++c)
-                {
-                    alpha = pSrcRow[c][3] / 255.;
-                    beta = 1. - alpha;
-                    pDstRow[c][0] = (uchar) pSrcRow[c][0]*alpha + pDstRow[c][0]*beta;
-                    pDstRow[c][1] = (uchar) pSrcRow[c][1]*alpha + pDstRow[c][1]*beta;
-                    pDstRow[c][2] = (uchar) pSrcRow[c][2]*alpha + pDstRow[c][2]*beta;
-                }
-            }
+            roiSrc.copyTo(roiDst);
         }
     }
+    else
+    {
+        Blend::over(roiSrc, roiDst);
+    }
 }
 
 void Widget::paintRelief()
 {
-     switch (relief)
+    showRelief(relief, fillColor);
+}
+
+void Widget::showRelief(Relief value, const Scalar &color)
+{
+    shownRelief = value;
+    shownColor = color;
+    flatDirty = true;
+}
+
+void Widget::rebuildFlat()
+{
+    flatDirty = false;
+    Theme *theme = ThemeRepository::getCurrentTheme();
+    Mat newBG;
+    if (bgSize.width > 0 && bgSize.height > 0)
     {
-    case FLAT:
-        ThemeRepository::getCurrentTheme()->flat(bg, fillColor);
-        break;
-    case RAISED:
-        ThemeRepository::getCurrentTheme()->raised(bg, fillColor);
-        break;
-    case SUNKEN:
-        ThemeRepository::getCurrentTheme()->sunken(bg, fillColor);
-        break;
-    case SELECTED:
-        ThemeRepository::getCurrentTheme()->selected(bg, fillColor);
-        break;
+        theme->allocateBG(newBG, bgSize, fillColor);
+        switch (shownRelief)
+        {
+        case FLAT:
+            theme->flat(newBG, shownColor);
+            break;
+        case RAISED:
+            theme->raised(newBG, shownColor);
+            break;
+        case SUNKEN:
+            theme->sunken(newBG, shownColor);
+            break;
+        case SELECTED:
+            theme->selected(newBG, shownColor);
+            break;
+        }
+    }
+    Mat newFG;
+    if (ownFG)
+    {
+        const Rect &rect = getRect();
+        if (rect.width && rect.height)
+        {
+            newFG = Mat::zeros(rect.height, rect.width, CV_8UC4);
+            drawFG(newFG);
+        }
     }
+    // never reuse the old buffer - whoever still holds it keeps a valid image
+    Mat newFlat;
+    if (! newBG.empty() || ! newFG.empty())
+    {
+        Blend::flatten(newBG, newFG, newFlat);
+    }
+    flat = newFlat;
 }
 
 void Widget::mousePressed()
@@ -463,7 +465,7 @@ void Widget::mouseLeave()
 
 void Widget::allocateBG(const Size &size)
 {
-    ThemeRepository::getCurrentTheme()->allocateBG(bg, size, fillColor);
+    bgSize = size;
     paintRelief();
 }
 
@@ -484,22 +486,22 @@ void Widget::setStretchY(bool value)
 
 void Widget::flatWidget()
 {
-    ThemeRepository::getCurrentTheme()->flat(bg, fillColor);
+    showRelief(FLAT, fillColor);
 }
 
 void Widget::raisedWidget()
 {
-    ThemeRepository::getCurrentTheme()->raised(bg, fillColor);
+    showRelief(RAISED, fillColor);
 }
 
 void Widget::sunkenWidget()
 {
-    ThemeRepository::getCurrentTheme()->sunken(bg, fillColor);
+    showRelief(SUNKEN, fillColor);
 }
 
 void Widget::selectedWidget()
 {
-    ThemeRepository::getCurrentTheme()->selected(bg, selectColor);
+    showRelief(SELECTED, selectColor);
 }
 
 void Widget::renderOn(Mat &dst)
@@ -507,26 +509,13 @@ void Widget::renderOn(Mat &dst)
     const Rect &rect = getRect();
     if (rect.width && rect.height)
     {
-        Rect dstRect({0,0}, dst.size());
-        Rect intersection = rect & dstRect;
-        if (intersection.width && intersection.height)
+        if (flatDirty)
         {
-            Mat roiDst(dst, intersection);
-            if (! bg.empty())
-            {
-                Mat roiSrcBG(bg, Rect(intersection.x - rect.x,
-                                      intersection.y - rect.y,
-                                      intersection.width, intersection.height));
-                mergeMats(roiSrcBG, roiDst);
-            }
-            if (! fg.empty())
-            {
-                Mat roiSrcFG(fg, Rect(intersection.x - rect.x,
-                                      intersection.y - rect.y,
-                                      intersection.width, intersection.height));
-                mergeMats(roiSrcFG, roiDst);
-            }
+            rebuildFlat();
         }
+        // a rebuild makes a new flat Mat, so it can be recorded by reference
+        Painter::image(dst, flat, rect.tl(), true, true);
+        Painter::image(dst, fg, rect.tl());
     }
 }
 
@@ -535,11 +524,16 @@ void Widget::callDrawFG(bool preAllocateMat)
     const Rect &rect = getRect();
     if (rect.width && rect.height)
     {
-        if (preAllocateMat)
+        ownFG = preAllocateMat;
+        if (ownFG)
+        {   // drawn when the flat buffer is rebuilt
+            fg.release();
+            flatDirty = true;
+        }
+        else
         {
-            fg = Mat::zeros(rect.height, rect.width, CV_8UC4);
+            drawFG(fg);
         }
-        drawFG(fg);
     }
 }
 
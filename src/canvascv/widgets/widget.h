@@ -311,7 +311,13 @@ protected:
     /// dst is the roi of the widget size and not the full image
     virtual void drawFG(cv::Mat &dst) = 0;
 
-    /// helper method which delgates to drawFG for derived
+    /**
+     * @brief helper method which delgates to drawFG for derived
+     *
+     * @param preAllocateMat if true, drawFG() is called later on a transparent Mat, when the
+     * bg and fg are flattened into a single buffer. If false, drawFG() is called now to
+     * set its own Mat, which is blended as is on every render.
+     */
     void callDrawFG(bool preAllocateMat=true);
 
     /// Minimal size the widget coould have occupy
@@ -411,6 +417,12 @@ private:
     /// called by the canvas when the widget changes state
     virtual void broadcastChange(State status);
 
+    /// the look painted on the bg when the flat buffer is rebuilt
+    void showRelief(Relief value, const cv::Scalar &color);
+
+    /// combine the bg and the drawFG() result into 'flat'
+    void rebuildFlat();
+
     /* TODO - write/read widgets to file for a designer app
     friend void write(cv::FileStorage& fs, const std::string&, const Widget& x);
     friend void read(const cv::FileNode& node, Widget*& x, const Widget* default_value);
@@ -421,12 +433,21 @@ private:
 
     cv::Scalar outlineColor;
     cv::Scalar fillColor;
-    cv::Mat bg;
-    cv::Mat fg;
+    cv::Mat fg; // only kept when drawFG() provides its own Mat (e.g. MatWidget)
+    cv::Mat flat; // premultiplied bg+fg, a new Mat on each rebuild
+    cv::Size bgSize;
+    Relief shownRelief;
+    cv::Scalar shownColor;
+    bool ownFG;
+    bool flatDirty;
     State state;
     bool isDirty;
     int updateCalls;
     std::list<CBWidgetState> changeNotifs;
+
+    // maintained by the Canvas for incremental redraw
+    bool damaged;
+    cv::Rect drawnRect;
 };
 
 /* TODO - write/read widgets to file for a designer app
@@ -0,0 +1,229 @@
+#include "zoneanalytics.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+ZoneAnalytics::ZoneAnalytics(Canvas &canvasVal)
+    : canvas(canvasVal),
+      trackTimeout(1),
+      labelZones(1),
+      labelStats(1),
+      zoneMapVersion(0),
+      remapNeeded(true)
+{
+    createCbId = canvas.notifyOnShapeCreate([this](Shape *shape)
+    {
+        if (ZoneMap::isZone(*shape)) addZone(shape->getId());
+    });
+    deleteCbId = canvas.notifyOnShapeDelete([this](Shape *shape)
+    {
+        if (ZoneMap::isZone(*shape)) rmvZone(shape->getId());
+    });
+
+    list<shared_ptr<Shape>> shapes;
+    canvas.getShapes(shapes);
+    for (auto &shape : shapes)
+    {
+        if (ZoneMap::isMapped(*shape)) addZone(shape->getId());
+    }
+}
+
+ZoneAnalytics::~ZoneAnalytics()
+{
+    canvas.rmvNotifyOnShapeCreate(createCbId);
+    canvas.rmvNotifyOnShapeDelete(deleteCbId);
+}
+
+void ZoneAnalytics::ingest(const Observation *observations, int count, double timestamp)
+{
+    const ZoneMap &zoneMap = canvas.getZoneMap();
+    if (remapNeeded || zoneMap.getVersion() != zoneMapVersion)
+    {
+        remap(zoneMap);
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        const Observation &observation = observations[i];
+        auto iter = tracks.find(observation.trackId);
+        if (iter == tracks.end())
+        {
+            TrackState state = {observation.pos, 0, timestamp};
+            iter = tracks.insert(make_pair(observation.trackId, state)).first;
+        }
+        TrackState &state = iter->second;
+
+        double elapsed = timestamp - state.lastSeen;
+        for (int index : labelStats[state.label])
+        {
+            stats[index].dwell += elapsed;
+        }
+
+        int label = zoneMap.getLabel(observation.pos);
+        if (label != state.label)
+        {
+            move(labelStats[state.label], labelStats[label]);
+            state.label = label;
+        }
+        state.pos = observation.pos;
+        state.lastSeen = timestamp;
+    }
+
+    // tracks which weren't seen for a while leave their zones
+    for (auto iter = tracks.begin(); iter != tracks.end(); )
+    {
+        if (timestamp - iter->second.lastSeen > trackTimeout)
+        {
+            move(labelStats[iter->second.label], labelStats[0]);
+            iter = tracks.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+}
+
+void ZoneAnalytics::ingest(const vector<Observation> &observations, double timestamp)
+{
+    ingest(observations.data(), (int)observations.size(), timestamp);
+}
+
+const vector<ZoneAnalytics::ZoneStats> &ZoneAnalytics::getStats() const
+{
+    return stats;
+}
+
+const ZoneAnalytics::ZoneStats *ZoneAnalytics::getZoneStats(int zoneId) const
+{
+    auto iter = statsIndex.find(zoneId);
+    return iter == statsIndex.end() ? nullptr : &stats[iter->second];
+}
+
+size_t ZoneAnalytics::getTrackCount() const
+{
+    return tracks.size();
+}
+
+void ZoneAnalytics::reset()
+{
+    for (auto &zone : stats)
+    {
+        zone.occupancy = 0;
+        zone.enters = zone.exits = 0;
+        zone.dwell = 0;
+    }
+    tracks.clear();
+}
+
+double ZoneAnalytics::getTrackTimeout() const
+{
+    return trackTimeout;
+}
+
+void ZoneAnalytics::setTrackTimeout(double value)
+{
+    trackTimeout = value;
+}
+
+void ZoneAnalytics::addZone(int zoneId)
+{
+    if (statsIndex.count(zoneId)) return;
+    ZoneStats zone = {zoneId, 0, 0, 0, 0};
+    statsIndex[zoneId] = (int)stats.size();
+    stats.push_back(zone);
+    addedZones.push_back(zoneId);
+    remapNeeded = true;
+}
+
+void ZoneAnalytics::rmvZone(int zoneId)
+{
+    auto iter = statsIndex.find(zoneId);
+    if (iter == statsIndex.end()) return;
+    int index = iter->second;
+    statsIndex.erase(iter);
+    if (index != (int)stats.size() - 1)
+    {   // the last one takes its place
+        stats[index] = stats.back();
+        statsIndex[stats[index].zoneId] = index;
+    }
+    stats.pop_back();
+    addedZones.erase(remove(addedZones.begin(), addedZones.end(), zoneId), addedZones.end());
+    remapNeeded = true;
+}
+
+void ZoneAnalytics::remap(const ZoneMap &zoneMap)
+{
+    auto toStats = [this](const vector<int> &zoneIds, bool skipAdded)
+    {
+        vector<int> indices;
+        for (int zoneId : zoneIds)
+        {
+            auto iter = statsIndex.find(zoneId);
+            if (iter == statsIndex.end()) continue;
+            if (skipAdded && find(addedZones.begin(), addedZones.end(), zoneId) != addedZones.end()) continue;
+            indices.push_back(iter->second);
+        }
+        sort(indices.begin(), indices.end());
+        return indices;
+    };
+
+    vector<vector<int>> newLabelStats(zoneMap.getLabelCount());
+    for (int label = 0; label < zoneMap.getLabelCount(); ++label)
+    {
+        newLabelStats[label] = toStats(zoneMap.getZones(label), false);
+    }
+
+    // move the tracks from the zones they were in to the zones they are in now.
+    // Zones added since the last remap had no tracks in them yet.
+    for (auto &track : tracks)
+    {
+        TrackState &state = track.second;
+        int label = zoneMap.getLabel(state.pos);
+        move(toStats(labelZones[state.label], true), newLabelStats[label]);
+        state.label = label;
+    }
+
+    labelZones.resize(zoneMap.getLabelCount());
+    for (int label = 0; label < zoneMap.getLabelCount(); ++label)
+    {
+        labelZones[label] = zoneMap.getZones(label);
+    }
+    labelStats.swap(newLabelStats);
+    addedZones.clear();
+    zoneMapVersion = zoneMap.getVersion();
+    remapNeeded = false;
+}
+
+void ZoneAnalytics::move(const vector<int> &from, const vector<int> &to)
+{
+    // both are sorted, so a merge finds what is only in one of them
+    auto i = from.begin(), j = to.begin();
+    while (i != from.end() || j != to.end())
+    {
+        if (j == to.end() || (i != from.end() && *i < *j))
+        {
+            ++stats[*i].exits;
+            --stats[*i].occupancy;
+            ++i;
+        }
+        else if (i == from.end() || *j < *i)
+        {
+            ++stats[*j].enters;
+            ++stats[*j].occupancy;
+            ++j;
+        }
+        else
+        {
+            ++i;
+            ++j;
+        }
+    }
+}
+
+}
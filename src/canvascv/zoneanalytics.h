@@ -0,0 +1,115 @@
+#ifndef ZONEANALYTICS_H
+#define ZONEANALYTICS_H
+
+#include "canvascv/canvas.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace canvascv
+{
+
+/**
+ * @brief The ZoneAnalytics class
+ *
+ * Counts tracked objects entering and leaving the zone shapes (Polygon, Rectangle and
+ * Ellipse) of a Canvas, their current occupancy and the time spent in them.
+ *
+ * - Zones are registered automatically as they are created or deleted on the Canvas.
+ * - Each frame, feed it the (track id, position) of all the tracked objects with ingest().
+ * - A track is only a position, a time and a ZoneMap label, so thousands of tracks are cheap.
+ * - Tracks which aren't seen for getTrackTimeout() seconds leave their zones.
+ */
+class ZoneAnalytics
+{
+public:
+    /// the position of a tracked object in a frame
+    struct Observation
+    {
+        int trackId;
+        cv::Point pos;
+    };
+
+    /// the counters of a zone
+    struct ZoneStats
+    {
+        int zoneId;        ///< the id of the zone Shape
+        int occupancy;     ///< tracks currently in the zone
+        uint64_t enters;   ///< times tracks entered the zone
+        uint64_t exits;    ///< times tracks left the zone (or disappeared in it)
+        double dwell;      ///< total seconds tracks spent in the zone
+    };
+
+    ZoneAnalytics(Canvas &canvas);
+
+    ~ZoneAnalytics();
+
+    /**
+     * @brief ingest the tracked objects of a frame
+     *
+     * @param observations is a contiguous array of the tracked objects positions
+     * @param count is the amount of observations
+     * @param timestamp is the frame time in seconds (increasing)
+     */
+    void ingest(const Observation *observations, int count, double timestamp);
+
+    /// ingest() all the observations of a vector
+    void ingest(const std::vector<Observation> &observations, double timestamp);
+
+    /// the stats of all the zones, in no specific order
+    const std::vector<ZoneStats> &getStats() const;
+
+    /// the stats of a zone by its Shape id, or null if it isn't a zone
+    const ZoneStats *getZoneStats(int zoneId) const;
+
+    /// the amount of tracks currently followed
+    size_t getTrackCount() const;
+
+    /// zero all the counters and forget all the tracks
+    void reset();
+
+    double getTrackTimeout() const;
+
+    /// seconds without an observation after which a track leaves its zones (1 by default)
+    void setTrackTimeout(double value);
+
+private:
+    ZoneAnalytics(const ZoneAnalytics&) = delete;
+    ZoneAnalytics &operator=(const ZoneAnalytics&) = delete;
+
+    struct TrackState
+    {
+        cv::Point pos;
+        int label;       ///< into labelStats
+        double lastSeen;
+    };
+
+    void addZone(int zoneId);
+    void rmvZone(int zoneId);
+
+    /// the zone map changed, so labels have new meanings
+    void remap(const ZoneMap &zoneMap);
+
+    /// count the exits and enters of a track moving between 2 sets of stats indices
+    void move(const std::vector<int> &from, const std::vector<int> &to);
+
+    Canvas &canvas;
+    Canvas::CBIDCanvasShape createCbId;
+    Canvas::CBIDCanvasShape deleteCbId;
+    double trackTimeout;
+
+    std::vector<ZoneStats> stats;
+    std::unordered_map<int, int> statsIndex;     // zone id -> index into stats
+    std::vector<int> addedZones;                 // zones added since the last remap
+    std::vector<std::vector<int>> labelZones;    // label -> zone ids (as of the last remap)
+    std::vector<std::vector<int>> labelStats;    // label -> sorted indices into stats
+    unsigned zoneMapVersion;
+    bool remapNeeded;
+
+    std::unordered_map<int, TrackState> tracks;
+};
+
+}
+
+#endif // ZONEANALYTICS_H
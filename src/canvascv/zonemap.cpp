@@ -0,0 +1,153 @@
+#include "zonemap.h"
+#include "shapeslotmap.h"
+#include "shapes/ellipse.h"
+#include "shapes/polygon.h"
+#include "shapes/rectangle.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+namespace canvascv
+{
+
+ZoneMap::ZoneMap()
+    : zoneSets(1), // label 0 is the empty set
+      version(0)
+{
+}
+
+bool ZoneMap::isZone(Shape &shape)
+{
+    const char *type = shape.getType();
+    return type == Polygon::type || type == Rectangle::type || type == Ellipse::type;
+}
+
+bool ZoneMap::isMapped(Shape &shape)
+{
+    return isZone(shape) && shape.isReady();
+}
+
+void ZoneMap::rebuild(const ShapeSlotMap &shapes, const Size &size)
+{
+    labels.create(size, CV_32SC1);
+    labels = Scalar::all(0);
+    zoneSets.resize(1);
+    transitions.clear();
+    ++version;
+
+    const Rect frame(Point(0, 0), size);
+    Mat mask;
+    for (auto &shape : shapes)
+    {
+        if (! isMapped(*shape)) continue;
+        Rect roi = shape->getBounds() & frame;
+        if (roi.area() == 0) continue;
+
+        mask.create(roi.size(), CV_8UC1);
+        mask = Scalar::all(0);
+        fill(*shape, mask, roi.tl());
+
+        int id = shape->getId();
+        int prevLabel = -1, newLabel = 0;
+        for (int r = 0; r < roi.height; ++r)
+        {
+            const uchar *pMask = mask.ptr<uchar>(r);
+            int *pLabel = labels.ptr<int>(roi.y + r) + roi.x;
+            for (int c = 0; c < roi.width; ++c)
+            {
+                if (! pMask[c]) continue;
+                if (pLabel[c] != prevLabel)
+                {   // neighbour pixels mostly share the label
+                    prevLabel = pLabel[c];
+                    newLabel = addZone(prevLabel, id);
+                }
+                pLabel[c] = newLabel;
+            }
+        }
+    }
+}
+
+void ZoneMap::getLabels(const Point *points, int count, int *result) const
+{
+    for (int i = 0; i < count; ++i)
+    {
+        result[i] = getLabel(points[i]);
+    }
+}
+
+const vector<int> &ZoneMap::getZones(int label) const
+{
+    return zoneSets[label];
+}
+
+int ZoneMap::getLabelCount() const
+{
+    return (int)zoneSets.size();
+}
+
+const Mat &ZoneMap::getLabelImage() const
+{
+    return labels;
+}
+
+unsigned ZoneMap::getVersion() const
+{
+    return version;
+}
+
+void ZoneMap::fill(Shape &shape, Mat &mask, const Point &offset)
+{
+    const char *type = shape.getType();
+    if (type == Polygon::type)
+    {
+        vector<Point> pts;
+        static_cast<Polygon&>(shape).getPoints(pts);
+        for (auto &pt : pts)
+        {
+            pt -= offset;
+        }
+        const Point *ppt = pts.data();
+        int npt = (int)pts.size();
+        fillPoly(mask, &ppt, &npt, 1, Scalar::all(255));
+    }
+    else
+    {
+        RotatedRect rect = static_cast<Rectangle&>(shape).getRect();
+        rect.center -= Point2f(offset);
+        if (type == Ellipse::type)
+        {
+            ellipse(mask, rect, Scalar::all(255), FILLED);
+        }
+        else
+        {
+            Point2f corners[4];
+            rect.points(corners);
+            Point pts[4];
+            for (int i = 0; i < 4; ++i)
+            {
+                pts[i] = corners[i];
+            }
+            fillConvexPoly(mask, pts, 4, Scalar::all(255));
+        }
+    }
+}
+
+int ZoneMap::addZone(int label, int id)
+{
+    auto key = make_pair(label, id);
+    auto iter = transitions.find(key);
+    if (iter != transitions.end()) return iter->second;
+
+    vector<int> zones = zoneSets[label];
+    zones.insert(lower_bound(zones.begin(), zones.end(), id), id);
+    zoneSets.push_back(zones);
+    int newLabel = (int)zoneSets.size() - 1;
+    transitions[key] = newLabel;
+    return newLabel;
+}
+
+}
@@ -0,0 +1,91 @@
+#ifndef ZONEMAP_H
+#define ZONEMAP_H
+
+#include <opencv2/core.hpp>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace canvascv
+{
+
+class Shape;
+class ShapeSlotMap;
+
+/**
+ * @brief The ZoneMap class
+ *
+ * A label image of the zone shapes (Polygon, Rectangle and Ellipse) of a Canvas. Each pixel
+ * holds a label, and each label stands for the set of zones covering that pixel, so the
+ * zones of a point are a single lookup instead of a geometry test per zone.
+ *
+ * The zones are rasterized like OpenCV fills them, so membership is exact to the pixel
+ * (the edges count as inside). Get it with Canvas::getZoneMap(), which rebuilds it when
+ * a zone shape changed.
+ *
+ * Only ready zones are mapped (see isMapped()), so a zone the user is still drawing is
+ * neither in the map nor rebuilds it as it changes. Invisible zones are mapped: hiding a
+ * zone hides its drawing, not its area.
+ */
+class ZoneMap
+{
+public:
+    ZoneMap();
+
+    /// true if shape is one of the zone shape types
+    static bool isZone(Shape &shape);
+
+    /// true if shape is a zone which is in the map (a ready one)
+    static bool isMapped(Shape &shape);
+
+    /// rasterize all the zones in shapes into a label image of 'size'
+    void rebuild(const ShapeSlotMap &shapes, const cv::Size &size);
+
+    /// the label of pos (0, the empty set, outside of the map)
+    int getLabel(const cv::Point &pos) const
+    {
+        if ((unsigned)pos.x >= (unsigned)labels.cols || (unsigned)pos.y >= (unsigned)labels.rows)
+        {
+            return 0;
+        }
+        return labels.at<int>(pos);
+    }
+
+    /// the labels of 'count' points into 'result'
+    void getLabels(const cv::Point *points, int count, int *result) const;
+
+    /// the ids of the zone shapes of a label, sorted
+    const std::vector<int> &getZones(int label) const;
+
+    /// the ids of the zone shapes at pos, sorted
+    const std::vector<int> &getZones(const cv::Point &pos) const
+    {
+        return getZones(getLabel(pos));
+    }
+
+    /// labels are in the range [0, getLabelCount())
+    int getLabelCount() const;
+
+    /// the CV_32SC1 label image
+    const cv::Mat &getLabelImage() const;
+
+    /// incremented by every rebuild, so the users of labels know when their meaning changed
+    unsigned getVersion() const;
+
+private:
+    /// fill the zone area into a CV_8UC1 mask, which is placed at 'offset' on the canvas
+    static void fill(Shape &shape, cv::Mat &mask, const cv::Point &offset);
+
+    /// the label of the set of 'label' and the zone 'id'
+    int addZone(int label, int id);
+
+    cv::Mat labels;
+    std::vector<std::vector<int>> zoneSets;
+    std::map<std::pair<int, int>, int> transitions;
+    unsigned version;
+};
+
+}
+
+#endif // ZONEMAP_H